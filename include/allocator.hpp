@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+
+// Storage hooks for Matrix buffers. A matrix keeps the allocator it was created
+// with, so switching the default never frees a buffer through the wrong hooks.
+struct MatrixAllocator {
+    const char* name;
+    void* (*allocate)(size_t bytes);
+    void (*deallocate)(void* ptr, size_t bytes);
+};
+
+namespace matrix_alloc {
+    constexpr size_t alignment = 64;
+
+    // 64-byte aligned global new/delete
+    extern const MatrixAllocator aligned;
+    // Power-of-two size classes cached per thread on top of `aligned`;
+    // blocks over 1 MiB bypass the cache. This is the default.
+    extern const MatrixAllocator pool;
+
+    // Allocator used by matrices constructed from now on
+    void set_default(const MatrixAllocator& alloc);
+    const MatrixAllocator& get_default();
+
+    struct PoolStats {
+        size_t hits, misses;
+    };
+    // Counters of the calling thread's pool cache
+    PoolStats pool_stats();
+    // Returns the calling thread's cached blocks to the system
+    void release_pool();
+}
+
+// std::allocator adapter over a MatrixAllocator
+template <class T>
+struct MatrixStorage {
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    const MatrixAllocator* alloc;
+
+    MatrixStorage() : alloc(&matrix_alloc::get_default()) {}
+    template <class U>
+    MatrixStorage(const MatrixStorage<U>& other) : alloc(other.alloc) {}
+
+    T* allocate(size_t n) { return (T*)alloc->allocate(n * sizeof(T)); }
+    void deallocate(T* ptr, size_t n) { alloc->deallocate(ptr, n * sizeof(T)); }
+
+    template <class U>
+    bool operator==(const MatrixStorage<U>& other) const { return alloc == other.alloc; }
+};
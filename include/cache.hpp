@@ -0,0 +1,64 @@
+#pragma once
+
+#include <span>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+// Bounded LRU map from (input vector, model version) to an inference result,
+// safe to share between threads. Entries are split over independently locked
+// shards by key hash, so concurrent lookups rarely contend. Each shard keeps the
+// entries of versions older than the newest one it has been given on a separate
+// LRU list (moved there in O(1) when a newer version arrives) and evicts from it
+// before touching any entry of the newest version; a full shard with no older
+// entries left drops inserts of an older version instead.
+class InferenceCache {
+    struct Entry {
+        uint64_t key, version;
+        std::vector<double> input, output;
+    };
+
+    struct alignas(64) Shard {
+        std::mutex lock;
+        std::list<Entry> lru;   // Entries of `newest`, most recently used first
+        std::list<Entry> stale; // Older versions, most recently used first
+        std::unordered_map<uint64_t, std::list<Entry>::iterator> index;
+        size_t capacity = 0;
+        uint64_t newest = 0;
+
+        std::list<Entry>& list_for(uint64_t version);
+    };
+
+    std::unique_ptr<Shard[]> shards;
+    size_t shard_count, total_capacity;
+    std::atomic<size_t> hits{0}, misses{0}, evictions{0};
+
+    Shard& shard_for(uint64_t key) const;
+
+    public:
+    // At most `capacity` entries in total. Shards hold capacity / shards entries
+    // each, one more for the first capacity % shards, and evict on their own, so
+    // a skewed key set can evict before the cache as a whole is full.
+    explicit InferenceCache(size_t capacity, size_t shards = 16);
+
+    // Copies the cached result into `output` and returns true on a hit. Inputs
+    // match bit for bit, so a hit returns exactly what the network computed.
+    bool lookup(std::span<const double> input, uint64_t version, std::vector<double>& output);
+    void insert(std::span<const double> input, uint64_t version, std::span<const double> output);
+    void clear();
+
+    struct Stats {
+        size_t hits, misses, evictions, entries;
+    };
+    Stats stats() const;
+    void reset_stats();
+    size_t capacity() const;
+};
+
+// Fast 64-bit hash of the bit patterns of `input`, mixed with `version`
+uint64_t hash_input(std::span<const double> input, uint64_t version);
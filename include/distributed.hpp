@@ -0,0 +1,77 @@
+#pragma once
+
+#include <span>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+
+// Loopback listening socket for one rank of a RingComm. Port 0 binds a free
+// port, read back with port(); create every rank's listener before starting the
+// ranks (e.g. before fork) so each can be told the port of the next one.
+class RingListener {
+    intptr_t sock = -1;
+    uint16_t bound_port = 0;
+    friend class RingComm;
+
+    public:
+    explicit RingListener(uint16_t port = 0);
+    RingListener(RingListener&& other) noexcept;
+    RingListener& operator=(RingListener&&) = delete;
+    ~RingListener();
+
+    uint16_t port() const;
+};
+
+// Ring of `world_size` processes connected over loopback TCP. Each rank sends to
+// rank r+1 and receives from rank r-1. Connecting, accepting and every transfer
+// give up (aborting like a failed assert) after `timeout_ms` without progress, so
+// a missing or dead peer cannot hang the other ranks.
+class RingComm {
+    int rank, world_size;
+    int timeout_ms;
+    intptr_t next_sock = -1; // Send side (to rank + 1)
+    intptr_t prev_sock = -1; // Receive side (from rank - 1)
+    std::vector<double> recv_buf;
+
+    // Background worker for allreduce_async. Spans are reduced in submission
+    // order, which must be the same on every rank.
+    std::thread worker;
+    std::mutex queue_lock;
+    std::condition_variable queue_cv;
+    std::deque<std::span<double>> queue;
+    size_t in_flight = 0;
+    bool stopping = false;
+
+    void connect_ring(RingListener& listener, uint16_t next_port);
+    void worker_loop();
+    // Runs on the worker thread only, so reductions never share the sockets or recv_buf
+    void ring_allreduce(std::span<double> buf);
+    void send_recv(std::span<const double> out, std::span<double> in);
+
+    public:
+    // Rank r listens on `base_port + r`
+    RingComm(int rank, int world_size, uint16_t base_port, int timeout_ms = 60000);
+    // Rank r accepts on its own `listener` and connects to `next_port`
+    RingComm(int rank, int world_size, RingListener listener, uint16_t next_port, int timeout_ms = 60000);
+    ~RingComm();
+    RingComm(const RingComm&) = delete;
+    RingComm& operator=(const RingComm&) = delete;
+
+    int get_rank() const;
+    int size() const;
+
+    // Sums `buf` element-wise across all ranks in place (reduce-scatter followed
+    // by all-gather, 2 * (N - 1) / N * |buf| values sent per rank).
+    // Every reduction, synchronous or not, runs on the worker thread in one
+    // submission order: allreduce() queues `buf` behind any pending
+    // allreduce_async calls and returns once all of them are done, so the two
+    // may be mixed freely as long as every rank issues them in the same order.
+    void allreduce(std::span<double> buf);
+
+    // Queues an allreduce on the worker thread. `buf` must stay alive until wait().
+    void allreduce_async(std::span<double> buf);
+    void wait();
+};
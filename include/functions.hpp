@@ -1,21 +1,25 @@
 #include <matrix.hpp>
 
 namespace nn_funcs {
-    Matrix sigmoid(const Matrix& m);
-    Matrix dsigmoid(const Matrix& m);
+    Matrix sigmoid(ConstMatrixView m);
+    Matrix dsigmoid(ConstMatrixView m);
 
-    Matrix softmax(const Matrix& m);
-    Matrix dsoftmax(const Matrix& m);
+    Matrix softmax(ConstMatrixView m);
+    Matrix dsoftmax(ConstMatrixView m);
 
-    size_t argmax(const Matrix& m);
+    size_t argmax(ConstMatrixView m);
 
-    Matrix relu(const Matrix& m);
-    Matrix drelu(const Matrix& m);
+    Matrix relu(ConstMatrixView m);
+    Matrix drelu(ConstMatrixView m);
 
-    double cross_entropy(const Matrix& y1, const Matrix& y2);
+    // activation_fn::Null: passes z through, derivative 1
+    Matrix identity(ConstMatrixView m);
+    Matrix didentity(ConstMatrixView m);
 
-    Matrix dcross_entropy(const Matrix& y1, const Matrix& y2);
+    double cross_entropy(ConstMatrixView y1, ConstMatrixView y2);
 
-    double squared_error(const Matrix& y1, const Matrix& y2);
-    Matrix dsquared_error(const Matrix& y1, const Matrix& y2);
+    Matrix dcross_entropy(ConstMatrixView y1, ConstMatrixView y2);
+
+    double squared_error(ConstMatrixView y1, ConstMatrixView y2);
+    Matrix dsquared_error(ConstMatrixView y1, ConstMatrixView y2);
 }
\ No newline at end of file
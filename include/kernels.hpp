@@ -0,0 +1,77 @@
+#pragma once
+
+#include <span>
+#include <cstddef>
+#include <cstdint>
+
+// Hot loops behind Matrix and nn_funcs, compiled once per instruction set and
+// picked at startup from CPUID, so one portable build runs the widest path the
+// host supports. Set NN_KERNELS=<isa> to force a variant.
+namespace kernels {
+    enum class dense_activation { None, Sigmoid, ReLU, Softmax };
+
+    // One layer of a compiled inference plan: out = activation(weights * in + bias),
+    // where in and out are offsets into the plan's scratch (in == npos reads the
+    // plan input)
+    struct DenseStep {
+        static constexpr size_t npos = (size_t)-1;
+        const double* weights;
+        size_t ldw;
+        const double* bias;
+        size_t rows, cols;
+        size_t in, out;
+        dense_activation activation;
+    };
+
+    struct KernelTable {
+        const char* isa;
+        // out(rows x cols) = lhs(rows x inner) * rhs(inner x cols); ld* are row strides
+        void (*gemm)(size_t rows, size_t inner, size_t cols, const double* lhs, size_t ldl,
+            const double* rhs, size_t ldr, double* out, size_t ldo);
+        // out(rows x cols) = lhs(rows x inner) * transpose(rhs(cols x inner))
+        void (*gemm_rt)(size_t rows, size_t inner, size_t cols, const double* lhs, size_t ldl,
+            const double* rhs, size_t ldr, double* out, size_t ldo);
+        // The same in float, for mixed precision
+        void (*sgemm)(size_t rows, size_t inner, size_t cols, const float* lhs, size_t ldl,
+            const float* rhs, size_t ldr, float* out, size_t ldo);
+        void (*sgemm_rt)(size_t rows, size_t inner, size_t cols, const float* lhs, size_t ldl,
+            const float* rhs, size_t ldr, float* out, size_t ldo);
+        // y += alpha * x
+        void (*axpy)(double alpha, const double* x, double* y, size_t n);
+        // y *= alpha
+        void (*scale)(double alpha, double* y, size_t n);
+        // y *= x element-wise
+        void (*mul)(const double* x, double* y, size_t n);
+        void (*relu)(const double* x, double* y, size_t n);
+        void (*drelu)(const double* x, double* y, size_t n);
+        void (*sigmoid)(const double* x, double* y, size_t n);
+        // sigmoid(x) * (1 - sigmoid(x))
+        void (*dsigmoid)(const double* x, double* y, size_t n);
+        // Runs `count` DenseSteps in order over `scratch` (see ExecutionPlan)
+        void (*dense_chain)(const DenseStep* steps, size_t count, const double* input, double* scratch);
+        // Philox4x32-10 blocks first .. first + count - 1 of (seed, stream), 4 words each
+        void (*philox)(uint64_t seed, uint64_t stream, uint64_t first, size_t count, uint32_t* out);
+        // out[i] = mean + stddev * normal `begin + i` of (seed, stream), by Box-Muller
+        // on the two uniforms of each block
+        void (*philox_normal)(uint64_t seed, uint64_t stream, uint64_t begin, size_t count,
+            double mean, double stddev, double* out);
+        // Inverted dropout mask from the same stream: mask[i] is 0 with probability
+        // `rate`, else 1 / (1 - rate)
+        void (*dropout_mask)(uint64_t seed, uint64_t stream, uint64_t begin, size_t count, double rate, double* mask);
+        // Batch norm of one feature over the n values of a batch:
+        // xhat = (z - mean) * inv_std, out = gamma * xhat + beta
+        void (*batch_norm)(const double* z, size_t n, double mean, double inv_std, double gamma, double beta,
+            double* xhat, double* out);
+        // Its backward pass through the batch mean and variance, from grad = dL/d(out):
+        // dgamma = sum(grad * xhat), dbeta = sum(grad) and
+        // dz = gamma * inv_std / n * (n * grad - dbeta - xhat * dgamma); dz may alias grad
+        void (*batch_norm_backward)(const double* grad, const double* xhat, size_t n, double gamma, double inv_std,
+            double* dgamma, double* dbeta, double* dz);
+    };
+
+    // Variant selected for this process (resolved on first use)
+    const KernelTable& active();
+
+    // Every variant the running CPU supports, narrowest first
+    std::span<const KernelTable* const> supported();
+}
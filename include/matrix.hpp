@@ -4,53 +4,118 @@
 #include <memory>
 #include <vector>
 #include <initializer_list>
+#include <type_traits>
+#include <allocator.hpp>
+#include <cassert>
+
+// Non-owning, strided 2-D window onto row-major storage: a Matrix, a block of
+// one, or memory owned by the caller (a mapped dataset, an external buffer).
+// The viewed memory must outlive the view.
+template <class T>
+class BasicMatrixView {
+    T* ptr;
+    size_t rows, cols, stride;
+
+    public:
+    BasicMatrixView(T* ptr, size_t rows, size_t cols, size_t stride)
+        : ptr(ptr), rows(rows), cols(cols), stride(stride) {}
+    // MatrixView -> ConstMatrixView
+    template <class U> requires std::is_convertible_v<U*, T*>
+    BasicMatrixView(const BasicMatrixView<U>& other)
+        : ptr(other.row_ptr(0)), rows(other.row_count()), cols(other.col_count()), stride(other.row_stride()) {}
+
+    std::span<T> operator[](size_t row) const { return std::span<T>(ptr + row * stride, cols); }
+    T* row_ptr(size_t row) const { return ptr + row * stride; }
+    size_t row_count() const { return rows; }
+    size_t col_count() const { return cols; }
+    size_t size() const { return rows * cols; }
+    size_t row_stride() const { return stride; }
+    bool is_contiguous() const { return rows <= 1 || stride == cols; }
+
+    // Sub-block starting at (row, col)
+    BasicMatrixView block(size_t row, size_t col, size_t num_rows, size_t num_cols) const {
+        assert(row + num_rows <= rows && col + num_cols <= cols && "block out of range");
+        return BasicMatrixView(ptr + row * stride + col, num_rows, num_cols, stride);
+    }
+    BasicMatrixView row_block(size_t row, size_t num_rows) const { return block(row, 0, num_rows, cols); }
+    BasicMatrixView col_block(size_t col, size_t num_cols) const { return block(0, col, rows, num_cols); }
+
+    // Row `row` seen as a (cols x 1) column vector, e.g. one example of a
+    // dataset stored one example per row
+    BasicMatrixView row_as_col(size_t row) const {
+        assert(row < rows && "row out of range");
+        return BasicMatrixView(ptr + row * stride, cols, 1, 1);
+    }
+};
+
+typedef BasicMatrixView<double> MatrixView;
+typedef BasicMatrixView<const double> ConstMatrixView;
 
 class Matrix {
     // Constructor initializer lists are initialized in the order defined
     // in the class 
     // e.g. Matrix(...) : length(3), _data(length) would pass an uninitialized `length`
     // were `std::vector<double> _data` to be declared before `size_t length`
-    size_t rows, cols, length;
-    std::vector<double> _data;
+    //
+    // `stride` is the distance between row starts; it exceeds `cols` only when
+    // row padding is enabled
+    size_t rows, cols, length, stride;
+    std::vector<double, MatrixStorage<double>> _data;
+
+    void axpy(double alpha, ConstMatrixView rhs);
 
     public:
+    // Process-wide: pad rows of matrices created from now on (other than column
+    // vectors) to a multiple of 8 doubles, so with the 64-byte aligned allocator
+    // every row starts on a cache line. Padding lanes hold zeros. Existing
+    // matrices keep their layout, so it is safe to toggle at any time, but
+    // matrices created concurrently on other threads may get either layout.
+    static void set_row_padding(bool enabled);
+
     explicit Matrix(size_t rows, size_t cols);
     Matrix(size_t cols, std::initializer_list<double> init);
     Matrix(double val, size_t rows, size_t cols);
-    
+    // Owning copy of a view
+    explicit Matrix(ConstMatrixView view);
+
+    operator ConstMatrixView() const;
+    operator MatrixView();
+    ConstMatrixView view() const;
+    MatrixView view();
+
     std::span<const double> operator[](size_t row) const;
     std::span<double> operator[](size_t row);
+    // Underlying storage; includes the padding lanes of padded matrices
     std::span<const double> data() const;
     std::span<double> data();
     size_t row_count() const;
     size_t col_count() const;
     size_t size() const;
+    size_t row_stride() const;
 
-    // Matrix ops
-
-    friend Matrix transpose(Matrix mat);
-
-    friend Matrix hadamard(Matrix lhs, const Matrix& rhs);
-
-    Matrix& operator+=(const Matrix& rhs);
-    friend Matrix operator+(Matrix lhs, const Matrix& rhs);
-
-    Matrix& operator-=(const Matrix& rhs);
-    friend Matrix operator-(Matrix lhs, const Matrix& rhs);
-
-    Matrix& operator*=(const Matrix& rhs);
-    friend Matrix operator*(const Matrix& lhs, const Matrix& rhs);
+    // Matrix ops. Operands are views, so Matrices, blocks of them and external
+    // buffers all go through the same kernels.
 
+    Matrix& operator+=(ConstMatrixView rhs);
+    Matrix& operator-=(ConstMatrixView rhs);
+    Matrix& operator*=(ConstMatrixView rhs);
     Matrix& operator*=(double scalar);
-    friend Matrix operator*(Matrix lhs, double scalar);
 
     /* Specialized matrix ops */
 
-    Matrix& add_col(const Matrix& rhs);
+    Matrix& add_col(ConstMatrixView rhs);
+};
 
-    // Matrix multiply right transpose
-    friend Matrix mmrt(const Matrix& lhs, const Matrix& rhs);
+Matrix transpose(ConstMatrixView mat);
 
-};
+Matrix hadamard(Matrix lhs, ConstMatrixView rhs);
+
+Matrix operator+(Matrix lhs, ConstMatrixView rhs);
+Matrix operator-(Matrix lhs, ConstMatrixView rhs);
+Matrix operator*(ConstMatrixView lhs, ConstMatrixView rhs);
+Matrix operator*(Matrix lhs, double scalar);
+
+// Matrix multiply right transpose
+Matrix mmrt(ConstMatrixView lhs, ConstMatrixView rhs);
 
-void print_mat(const Matrix& mat);
+void print_mat(ConstMatrixView mat);
@@ -1,10 +1,19 @@
 #pragma once
 
 #include <matrix.hpp>
+#include <precision.hpp>
+#include <rng.hpp>
+#include <cache.hpp>
+#include <kernels.hpp>
 #include <span>
 #include <utility>
+#include <functional>
+#include <memory>
 
-typedef Matrix (*Activation)(const Matrix&);
+class RingComm;
+struct ServingSnapshot;
+
+typedef Matrix (*Activation)(ConstMatrixView);
 
 enum class activation_fn {
     Null,
@@ -26,6 +35,9 @@ enum class output_type {
 struct LayerParams {
     Matrix weights;
     Matrix bias;
+    // Batch norm scale and shift; empty unless the layer is batch-normalized
+    Matrix gamma = Matrix(0, 0);
+    Matrix beta = Matrix(0, 0);
 
     LayerParams(size_t input_size, size_t output_size);
     LayerParams(Matrix weights, Matrix bias);
@@ -36,13 +48,72 @@ class Layer {
     LayerParams params;
     Activation activation;
     Activation diff_activation;
+    activation_fn activation_type = activation_fn::Null;
+    // Statistics batch norm normalizes z = W a + b with, before params.gamma/beta
+    Matrix norm_mean = Matrix(0, 0);
+    Matrix norm_var = Matrix(0, 0);
+    // Probability of zeroing each output while training
+    double dropout = 0.0;
+
+    bool has_batch_norm() const;
 
-    Layer(size_t input_size, size_t output_size, bool is_random = true);
+    // Zero parameters, or N(0, 2 / (in + out)) drawn from the stream of `init`
+    Layer(size_t input_size, size_t output_size, const Philox* init = nullptr);
 };
 
+// dropout and batch_norm apply to hidden/output layers; dropout not to the output
 struct LayerDefs {
     unsigned int num_nodes;
     activation_fn activation = activation_fn::Null;
+    double dropout = 0.0;
+    bool batch_norm = false;
+};
+
+constexpr double norm_epsilon = 1e-5;
+
+// The inference form of a layer stack: batch norm folded into the weights and
+// bias of its layer (W' = diag(s) W, b' = s (b - mean) + beta with
+// s = gamma / sqrt(var + eps)) and dropout removed
+std::vector<Layer> fold_for_inference(const std::vector<Layer>& layers);
+
+// Inference-only schedule compiled from a folded layer stack (fold_for_inference):
+// one fused step per layer (Gemv, bias, activation) with resolved shapes. run()
+// makes a single call to the dense_chain kernel of the instruction set chosen
+// when the plan was built, whose loop calls the gemv, bias and activation
+// kernels of that same set directly. Layer outputs alternate between two
+// scratch buffers (each layer reads the previous one's output and nothing
+// older is live), so the working set is the two largest alternating outputs
+// rather than the sum of every layer's buffers. Training
+// (forward_prop/backward_prop) does not use the plan and still calls through
+// each Layer's activation pointers.
+class ExecutionPlan {
+    std::vector<kernels::DenseStep> steps;
+    void (*dense_chain)(const kernels::DenseStep*, size_t, const double*, double*) = nullptr;
+    size_t input_size = 0, output_size = 0, output_offset = 0;
+    size_t scratch_doubles = 0, unshared_doubles = 0;
+
+    public:
+    ExecutionPlan() = default;
+    // Compiles and binds the plan to `layers`
+    explicit ExecutionPlan(const std::vector<Layer>& layers);
+
+    // Points the steps at the parameters of `layers`, which must have the shapes
+    // the plan was compiled for. The plan reads them on every run(), so they must
+    // stay alive and in place; bind again after copying the plan or replacing
+    // parameter matrices.
+    void bind(const std::vector<Layer>& layers);
+
+    // Doubles of scratch needed by run(), and what it would take without reuse
+    size_t scratch_size() const;
+    size_t unshared_size() const;
+
+    std::span<const double> run(std::span<const double> input, std::span<double> scratch) const;
+};
+
+// Hidden layer widths before and after prune_network
+struct PruneReport {
+    std::vector<size_t> nodes_before;
+    std::vector<size_t> nodes_after;
 };
 
 class Network {
@@ -50,23 +121,190 @@ class Network {
     std::vector<Matrix> activations;
     std::vector<Layer> layers;
     std::vector<LayerParams> deltas;
-    double (*cost_func)(const Matrix&, const Matrix&);
-    Matrix (*dcost_func)(const Matrix&, const Matrix&);
-    Matrix (Network::*output_err)(const Matrix&);
+    double (*cost_func)(ConstMatrixView, ConstMatrixView);
+    Matrix (*dcost_func)(ConstMatrixView, ConstMatrixView);
+    Matrix (Network::*output_err)(ConstMatrixView);
+
+    // The input of the current pass, used in place of activations[0] so callers'
+    // buffers are never copied. Only set between forward_pass and the end of the
+    // backward_prop that follows it; empty otherwise.
+    ConstMatrixView input_view{nullptr, 0, 0, 0};
+    ConstMatrixView layer_input(size_t l) const;
+
+    // Activation checkpointing: 0 keeps every layer's z/activation, k > 0 keeps
+    // only activations[l] with l % k == 0 (plus the output) and recomputes the
+    // layers in between during backward_prop.
+    size_t checkpoint_every = 0;
+    size_t live_bytes = 0, peak_bytes = 0;
+
+    // Mixed precision: GEMMs run on copies of the weights rounded to the 16-bit
+    // format (held as floats, see HalfMatrix) while layers[i].params stays the
+    // full precision master copy. The output error is multiplied by loss_scale;
+    // steps with non-finite gradients are skipped and halve it,
+    // `loss_scale_window` finite steps in a row double it, up to max_loss_scale
+    // so long clean runs cannot overflow it. parameters() marks the
+    // copies stale and the next forward pass re-rounds them.
+    precision compute_precision = precision::Double;
+    std::vector<HalfMatrix> half_weights;
+    bool half_weights_stale = false;
+    static constexpr double max_loss_scale = 16777216.0; // 2^24
+    double loss_scale = 1.0;
+    int good_steps = 0, loss_scale_window = 2000;
 
-    void backward_prop(Matrix target);
-    Matrix output_error(const Matrix& target);
-    Matrix output_error_softcross(const Matrix& target);
+    void forward_layer(size_t l);
+    void recompute_segment(size_t begin, size_t end);
+    void release_segment(size_t begin, size_t end);
+    // live_bytes is kept current per node layer as buffers are built and freed
+    size_t layer_bytes(size_t l) const;
+    void note_layer(size_t l, size_t held);
+    void release_layer(size_t l, bool keep_activation);
+    void count_memory();
+
+    // Parameter init, shuffling and stochastic layers draw from fixed substreams
+    // of this generator, so a seed reproduces a run
+    Philox rng{0};
+    uint64_t shuffle_round = 0;
+
+    // Dropout and batch norm. In training mode batch norm normalizes each feature
+    // with the mean and variance over the columns (examples) of the current pass
+    // and backpropagates through them, so networks with batch norm train on whole
+    // mini-batches at once. The running statistics average the batch moments
+    // (gathered in norm_sums/norm_squares) and are used only in evaluation mode and
+    // for inference. In training mode hidden outputs are multiplied by a dropout
+    // mask that is regenerated from (seed, layer, example round) when needed
+    // rather than stored; column j of a pass uses round dropout_round + j.
+    bool training = false, collect_norm_stats = false;
+    uint64_t dropout_round = 0;
+    std::vector<Matrix> norm_values;                // xhat per node layer, like z_values
+    std::vector<Matrix> norm_inv_std;               // 1 / sqrt(var + eps) used per node layer
+    std::vector<Matrix> norm_sums, norm_squares;    // Moments of z over the current batch
+    double norm_count = 0.0, norm_momentum = 0.1;
+    size_t norm_updates = 0;
+    Matrix dropout_mask(size_t l, size_t batch) const;
+    void batch_normalize(size_t l, const Matrix& z);
+    // Folds the batch moments into the running statistics (only for applied steps)
+    void update_norm_stats();
+    void clear_norm_sums();
+    bool trains_in_batches() const;
+
+    // Folded copy of `layers` served by infer() when any layer is batch-normalized
+    std::vector<Layer> serving_layers;
+    bool serving_stale = true;
+    const std::vector<Layer>& inference_layers();
+
+    // Unique across all networks and redrawn on every parameter change, so
+    // cached results of older parameters (or of a diverged copy) never hit
+    uint64_t model_version = 0;
+    std::shared_ptr<InferenceCache> cache;
+    std::vector<double> cached_output;
+    void parameters_changed();
+
+    ExecutionPlan plan;
+    std::vector<double> plan_scratch;
+    void compile_plan();
+    void refresh_half_weights();
+    bool apply_update(const std::vector<LayerParams>& delta_sum, double step);
+
+    // forward_prop that keeps `input` viewed for the backward_prop that follows;
+    // the input must stay alive until then, so temporaries cannot bind
+    Matrix& forward_pass(ConstMatrixView input);
+    Matrix& forward_pass(Matrix&& input) = delete;
+    // `layer_done(l)` is called as soon as deltas[l] is final, back to front.
+    // Ends the pass: input_view is cleared.
+    void backward_prop(ConstMatrixView target, const std::function<void(size_t)>& layer_done = {});
+    Matrix output_error(ConstMatrixView target);
+    Matrix output_error_softcross(ConstMatrixView target);
+    // Runs the training examples in the columns of `input` and adds their gradient
+    // to delta_sum, layer by layer (calling layer_done(l) once layer l's sum is final)
+    void accumulate_example(ConstMatrixView input, ConstMatrixView target, std::vector<LayerParams>& delta_sum,
+        const std::function<void(size_t)>& layer_done = {});
+    // The same over inputs[i] -> targets[i]: one example at a time, or side by side
+    // in a single pass when batch norm needs the batch statistics. layer_done sees
+    // only the final sums.
+    void accumulate_batch(std::span<const ConstMatrixView> inputs, std::span<const ConstMatrixView> targets,
+        std::vector<LayerParams>& delta_sum, const std::function<void(size_t)>& layer_done = {});
+    std::vector<LayerParams> zeroed_deltas() const;
 
     public:
-    Matrix& forward_prop(Matrix input);
+    // The result is owned by the network and valid until its next pass. `input`
+    // is only read during the call; no view of it is kept afterwards.
+    Matrix& forward_prop(ConstMatrixView input);
+
+    // Inference through the compiled plan. The result points into scratch owned
+    // by the network and is valid until the next call. Not safe while training
+    // runs; serve through a SnapshotStore (serving.hpp) for that.
+    std::span<const double> infer(ConstMatrixView input);
+    const ExecutionPlan& execution_plan() const;
+
+    // Optional result cache in front of infer(); nullptr disables it. Copies of
+    // the network share it. Every parameter update changes version(), which
+    // invalidates earlier entries.
+    void set_inference_cache(std::shared_ptr<InferenceCache> shared);
+    const std::shared_ptr<InferenceCache>& inference_cache() const;
+    uint64_t version() const;
+
+    // Keeps about L / k activations, plus the z and activation of each of the k
+    // layers of the segment being recomputed, for one extra forward pass per
+    // example: L / k + 2k buffers, least near k = sqrt(L / 2). k = 1 keeps every
+    // activation and only drops the z values.
+    void set_checkpointing(size_t every);
+    // Peak bytes held in z_values/activations since the last reset
+    size_t peak_activation_bytes() const;
+    void reset_memory_stats();
+
+    // Cost summed over the examples in the columns of `input`, and its gradient
+    // with respect to every layer's parameters (deltas, valid until the next
+    // backward pass; multiplied by the loss scale under mixed precision). Used to
+    // verify backward_prop numerically. Like forward_prop, neither keeps a view
+    // of `input` or `target` after returning.
+    double cost(ConstMatrixView input, ConstMatrixView target);
+    const std::vector<LayerParams>& gradient(ConstMatrixView input, ConstMatrixView target);
+    size_t layer_count() const;
+    // Edits are seen by the next forward_prop (and so cost, gradient and
+    // training) and infer, in every precision. Counts as a parameter change:
+    // call again before further edits.
+    LayerParams& parameters(size_t layer);
+
+    // Training mode applies dropout in forward_prop, cost and gradient (with the
+    // masks of the current round) and normalizes with the statistics of the
+    // columns passed in. The train functions always run in it.
+    void set_training(bool enabled);
+
+    void set_precision(precision p, double initial_loss_scale = 65536.0, int window = 2000);
+    double current_loss_scale() const;
 
     void train(int iters, std::span<std::pair<const Matrix, const Matrix>> batch, double eta);
+    // Zero-copy variant over one example per row, e.g. a row_block of a dataset
+    void train(int iters, ConstMatrixView inputs, ConstMatrixView targets, double eta);
+    // Mini-batch SGD over rows visited in a freshly shuffled order every epoch
+    void train_sgd(int epochs, ConstMatrixView inputs, ConstMatrixView targets, size_t batch_size, double eta);
 
-    friend Network define_network(std::vector<LayerDefs> layers, cost_fn cost_function, output_type output_def);  
+    // A new permutation of 0..n-1 on every call, reproducible from the seed
+    std::vector<size_t> shuffled_order(size_t n);
+    uint64_t seed() const;
+
+    // Data-parallel training: every rank trains on its own `shard` and the summed
+    // gradients are all-reduced layer by layer while the last backward pass runs.
+    // Without batch norm the shard is backpropagated one example at a time, so
+    // communication only overlaps the last example's backward pass; with batch
+    // norm the whole shard is that one pass.
+    void sync_parameters(RingComm& comm);
+    void train_distributed(int iters, std::span<std::pair<const Matrix, const Matrix>> shard, double eta, RingComm& comm);
+
+    friend Network define_network(std::vector<LayerDefs> layers, cost_fn cost_function, output_type output_def, uint64_t seed);
+    friend Network prune_network(const Network& network, std::span<const Matrix> calibration, double threshold, PruneReport* report);
+    friend std::unique_ptr<const ServingSnapshot> make_snapshot(Network& network);
 };
 
-Network define_network(std::vector<LayerDefs> layers, cost_fn cost_function, output_type output_def); 
+// Pass a fixed `seed` for reproducible initialization and shuffling
+Network define_network(std::vector<LayerDefs> layers, cost_fn cost_function, output_type output_def, uint64_t seed = random_seed());
+
+// Removes hidden neurons whose output barely varies over `calibration`: a neuron
+// is dropped when (max - min) of its activation times its largest outgoing weight
+// (scaled by the next layer's batch norm, if any) is <= threshold, and its mean
+// output is folded into the next layer's bias.
+// threshold = 0 removes only constant (e.g. dead ReLU) neurons, which is exact.
+Network prune_network(const Network& network, std::span<const Matrix> calibration, double threshold, PruneReport* report = nullptr);
 
 
 class AdamOptimizer {
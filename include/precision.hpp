@@ -0,0 +1,51 @@
+#pragma once
+
+#include <matrix.hpp>
+#include <vector>
+#include <cstdint>
+
+enum class precision {
+    Double,
+    BFloat16,
+    Float16
+};
+
+// Software conversions between float and 16-bit storage formats (round to nearest even)
+namespace half_bits {
+    uint16_t from_float(float val, precision format);
+    float to_float(uint16_t bits, precision format);
+}
+
+// Rounds `val` through a 16-bit format and back
+double round_to(double val, precision format);
+
+// Read-only copy of a Matrix rounded to a 16-bit format, used as a GEMM
+// operand. The 16-bit storage is emulated: values are rounded once, when
+// assigned, and held as decoded floats so products run through the float
+// kernels. It takes half the memory of the double matrix, not a quarter, and
+// results are widened back to double. Each product also rounds its other
+// operand and copies the result, so it only beats the double kernels when the
+// layers are wide enough for the GEMM to dominate (see src/bin/mixed.cpp).
+class HalfMatrix {
+    size_t rows, cols;
+    precision format;
+    std::vector<float> _data;
+
+    public:
+    HalfMatrix(const Matrix& mat, precision format);
+
+    // Re-rounds `mat` into this copy, reusing its storage
+    void assign(const Matrix& mat);
+
+    size_t row_count() const;
+    size_t col_count() const;
+
+    // lhs * rhs, with rhs rounded to lhs's format
+    friend Matrix operator*(const HalfMatrix& lhs, ConstMatrixView rhs);
+
+    // Matrix multiply left transpose: transpose(lhs) * rhs
+    friend Matrix mmlt(const HalfMatrix& lhs, ConstMatrixView rhs);
+};
+
+// mmrt with both operands rounded to `format` and float accumulation
+Matrix mmrt(ConstMatrixView lhs, ConstMatrixView rhs, precision format);
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <span>
+#include <array>
+#include <cstdint>
+#include <cstddef>
+
+// Counter-based generator (Philox4x32-10). Value `i` of a stream is a pure
+// function of (seed, stream, i) rather than of the values drawn before it, so a
+// fill split across any number of threads matches a serial one and streams for
+// different purposes (each layer's init, shuffling, dropout) never overlap.
+class Philox {
+    uint64_t seed, stream;
+
+    public:
+    explicit Philox(uint64_t seed, uint64_t stream = 0);
+
+    // Same seed, independent stream
+    Philox substream(uint64_t stream) const;
+    uint64_t get_seed() const;
+
+    // The 128 random bits at `counter`
+    std::array<uint32_t, 4> block(uint64_t counter) const;
+    // 64 random bits / a uniform double in (0, 1) at `index`. Each call runs the
+    // block kernel for a single block; use fill_bits for runs of values.
+    uint64_t bits(uint64_t index) const;
+    double uniform(uint64_t index) const;
+    // out[i] = bits(offset + i), generating all the blocks in one kernel call per chunk
+    void fill_bits(std::span<uint64_t> out, uint64_t offset = 0) const;
+
+    // out[i] ~ N(mean, stddev^2) is element `offset + i` of the stream (Box-Muller
+    // on pairs of blocks). Large fills use up to `threads` threads (0 = all cores);
+    // the result does not depend on the count.
+    void fill_normal(std::span<double> out, double mean, double stddev, uint64_t offset = 0, unsigned threads = 0) const;
+
+    // Inverted dropout mask over elements `offset + i`: 0 with probability `rate`,
+    // else 1 / (1 - rate)
+    void fill_dropout_mask(std::span<double> out, double rate, uint64_t offset = 0) const;
+
+    // Fisher-Yates over `order`, drawing from the start of the stream
+    void shuffle(std::span<size_t> order) const;
+};
+
+// Seed from the hardware random source, for runs that need not be reproducible
+uint64_t random_seed();
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <network2.hpp>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <span>
+#include <cstdint>
+
+// Immutable inference-ready copy of a network's parameters (batch norm folded,
+// dropout removed) with its compiled plan. `version` is Network::version() at
+// the time of the copy, so it can key an InferenceCache.
+struct ServingSnapshot {
+    std::vector<Layer> layers;
+    ExecutionPlan plan;
+    uint64_t version;
+
+    explicit ServingSnapshot(const std::vector<Layer>& folded, uint64_t version);
+    // The plan is bound to this snapshot's own layers
+    ServingSnapshot(const ServingSnapshot&) = delete;
+    ServingSnapshot& operator=(const ServingSnapshot&) = delete;
+    // Result points into `scratch`
+    std::span<const double> infer(ConstMatrixView input, std::vector<double>& scratch) const;
+};
+
+// Read-copy-update store for serving while a trainer keeps updating the network.
+// The trainer publishes whole snapshots with one atomic pointer swap, so readers
+// never see a half-written update. Readers pin the current snapshot by announcing
+// the epoch they started in: a store and two loads, with no locks, retries or
+// reference counts (wait-free). Replaced snapshots are retired and freed by a
+// later publish or reclaim() once every reader that could hold them has unpinned.
+class SnapshotStore {
+    static constexpr uint64_t idle = 0;
+
+    struct alignas(64) ReaderSlot {
+        std::atomic<uint64_t> epoch{idle};
+        std::atomic<bool> claimed{false};
+    };
+
+    std::atomic<const ServingSnapshot*> current{nullptr};
+    std::atomic<uint64_t> epoch{1};
+    std::unique_ptr<ReaderSlot[]> slots;
+    size_t slot_count;
+
+    // Writer side only
+    struct Retired {
+        const ServingSnapshot* snapshot;
+        uint64_t epoch;
+    };
+    std::mutex writer_lock;
+    std::vector<Retired> retired;
+    size_t reclaim_locked();
+
+    public:
+    class Reader;
+
+    // RAII pin of the snapshot that was current when it was taken
+    class Pin {
+        std::atomic<uint64_t>* slot;
+        const ServingSnapshot* snapshot;
+        Pin(std::atomic<uint64_t>* slot, const ServingSnapshot* snapshot);
+        friend class Reader;
+
+        public:
+        Pin(const Pin&) = delete;
+        Pin& operator=(const Pin&) = delete;
+        ~Pin();
+        const ServingSnapshot& operator*() const;
+        const ServingSnapshot* operator->() const;
+    };
+
+    // A serving thread's registration: one reader slot and inference scratch.
+    // Use from one thread at a time, with at most one Pin alive.
+    class Reader {
+        SnapshotStore* store;
+        size_t slot;
+        std::vector<double> scratch;
+
+        public:
+        explicit Reader(SnapshotStore& store);
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
+        ~Reader();
+
+        Pin pin();
+        // Runs the current snapshot; the result is valid until the next call
+        std::span<const double> infer(ConstMatrixView input, uint64_t* version = nullptr);
+    };
+
+    // Up to `max_readers` Readers may be registered at once
+    explicit SnapshotStore(size_t max_readers = 64);
+    // No Reader may outlive the store
+    ~SnapshotStore();
+
+    // Makes `snapshot` current; safe to call while readers are pinned. Returns
+    // the number of retired snapshots still waiting for readers.
+    size_t publish(std::unique_ptr<const ServingSnapshot> snapshot);
+    size_t reclaim();
+};
+
+// Snapshot of `network`'s current parameters for SnapshotStore::publish
+std::unique_ptr<const ServingSnapshot> make_snapshot(Network& network);
@@ -0,0 +1,98 @@
+#include <allocator.hpp>
+#include <new>
+#include <vector>
+#include <atomic>
+
+namespace matrix_alloc {
+    static void* aligned_allocate(size_t bytes) {
+        return ::operator new(bytes, std::align_val_t(alignment));
+    }
+
+    static void aligned_deallocate(void* ptr, size_t) {
+        ::operator delete(ptr, std::align_val_t(alignment));
+    }
+
+    // Size classes 64 B, 128 B, ... 1 MiB
+    constexpr size_t min_class_bits = 6, max_class_bits = 20;
+    constexpr size_t num_classes = max_class_bits - min_class_bits + 1;
+
+    static size_t size_class(size_t bytes) {
+        size_t c = 0;
+        while (((size_t)1 << (c + min_class_bits)) < bytes) c++;
+        return c;
+    }
+
+    struct PoolCache {
+        std::vector<void*> free_blocks[num_classes];
+        PoolStats stats = { 0, 0 };
+        ~PoolCache();
+    };
+
+    // Trivially destructible flag so matrices freed during thread/static teardown
+    // skip the cache once it is gone
+    static thread_local bool cache_alive = false;
+    static thread_local PoolCache cache;
+
+    PoolCache::~PoolCache() {
+        cache_alive = false;
+        for (auto& blocks : free_blocks)
+            for (void* block : blocks) aligned_deallocate(block, 0);
+    }
+
+    static PoolCache* thread_cache() {
+        static thread_local bool constructed = false;
+        if (!constructed) {
+            constructed = true;
+            cache.stats = { 0, 0 }; // First use constructs the thread's cache
+            cache_alive = true;
+        }
+        return cache_alive ? &cache : nullptr;
+    }
+
+    static void* pool_allocate(size_t bytes) {
+        if (bytes > ((size_t)1 << max_class_bits)) return aligned_allocate(bytes);
+        size_t c = size_class(bytes);
+        PoolCache* pool = thread_cache();
+        if (pool && !pool->free_blocks[c].empty()) {
+            void* block = pool->free_blocks[c].back();
+            pool->free_blocks[c].pop_back();
+            pool->stats.hits++;
+            return block;
+        }
+        if (pool) pool->stats.misses++;
+        return aligned_allocate((size_t)1 << (c + min_class_bits));
+    }
+
+    static void pool_deallocate(void* ptr, size_t bytes) {
+        if (bytes > ((size_t)1 << max_class_bits)) return aligned_deallocate(ptr, bytes);
+        size_t c = size_class(bytes);
+        // Cache at most ~1 MiB (and at least 8 blocks) per class and thread
+        size_t cap = ((size_t)1 << max_class_bits) >> (c + min_class_bits);
+        if (cap < 8) cap = 8;
+        PoolCache* pool = thread_cache();
+        if (!pool || pool->free_blocks[c].size() >= cap) return aligned_deallocate(ptr, bytes);
+        pool->free_blocks[c].push_back(ptr);
+    }
+
+    const MatrixAllocator aligned = { "aligned", aligned_allocate, aligned_deallocate };
+    const MatrixAllocator pool = { "pool", pool_allocate, pool_deallocate };
+
+    static std::atomic<const MatrixAllocator*> default_alloc{&pool};
+
+    void set_default(const MatrixAllocator& alloc) { default_alloc.store(&alloc); }
+    const MatrixAllocator& get_default() { return *default_alloc.load(std::memory_order_relaxed); }
+
+    PoolStats pool_stats() {
+        PoolCache* pool = thread_cache();
+        return pool ? pool->stats : PoolStats{ 0, 0 };
+    }
+
+    void release_pool() {
+        PoolCache* pool = thread_cache();
+        if (!pool) return;
+        for (auto& blocks : pool->free_blocks) {
+            for (void* block : blocks) aligned_deallocate(block, 0);
+            blocks.clear();
+        }
+    }
+}
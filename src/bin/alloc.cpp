@@ -0,0 +1,94 @@
+#include <matrix.hpp>
+#include <allocator.hpp>
+#include <vector>
+#include <network2.hpp>
+#include <functions.hpp>
+#include <utility>
+#include <cstdint>
+#include <stdio.h>
+#include <chrono>
+
+// Trains the race.cpp network under each Matrix storage configuration, in
+// double and both 16-bit modes, and reports training time, pool reuse and row
+// alignment. Storage must not change results: every configuration has to fit
+// all 16 inputs and give bit-identical outputs to unpadded aligned storage.
+// Training under the pool has to be served from its cache, and training
+// without it must not touch the cache.
+
+Matrix encode(unsigned int input) {
+    Matrix mat(0.0, 4, 1);
+    for (int j = 3; j >= 0; j--) mat.data()[3 - j] = (double)((input >> j) & 1);
+    return mat;
+}
+
+// Returns nonzero on failure; the trained outputs are appended to `outputs`
+int run(const MatrixAllocator& alloc, bool padded, precision mode, std::vector<double>& outputs) {
+    using namespace std::chrono;
+    matrix_alloc::set_default(alloc);
+    Matrix::set_row_padding(padded);
+
+    Network network = define_network(
+        {
+            {4, activation_fn::Null},
+            {8, activation_fn::ReLU},
+            {30, activation_fn::ReLU},
+            {16, activation_fn::Sigmoid},
+            {16, activation_fn::Sigmoid}
+        }, cost_fn::SquaredError, output_type::Dist, 1
+    );
+    network.set_precision(mode);
+    std::vector<std::pair<const Matrix, const Matrix>> training_data;
+    for (int i = 0; i < 16; i++) {
+        Matrix out(0.0, 16, 1);
+        out.data()[i] = 1.0;
+        training_data.push_back({encode(i), out});
+    }
+
+    // Every row of a padded 30x8 matrix must start on a cache line
+    Matrix probe(30, 8 + padded);
+    bool aligned = true;
+    for (size_t r = 0; r < probe.row_count(); r++)
+        aligned &= (uintptr_t)probe[r].data() % matrix_alloc::alignment == 0;
+
+    auto before = matrix_alloc::pool_stats();
+    auto start = high_resolution_clock::now();
+    network.train(2000, training_data, 0.78);
+    auto stop = high_resolution_clock::now();
+    auto after = matrix_alloc::pool_stats();
+
+    int correct = 0;
+    for (unsigned int i = 0; i < 16; i++) {
+        Matrix input = encode(i);
+        Matrix output = network.forward_prop(input);
+        correct += nn_funcs::argmax(output) == i;
+        outputs.insert(outputs.end(), output.data().begin(), output.data().end());
+    }
+    size_t hits = after.hits - before.hits, misses = after.misses - before.misses;
+    bool pooled = &alloc == &matrix_alloc::pool ? hits > 0 : hits + misses == 0;
+    printf("%-8s padding %-3s  train %7.1f ms  pool hits %zu misses %zu  rows aligned %s  accuracy %d/16%s\n",
+        alloc.name, padded ? "on" : "off", duration<double, std::milli>(stop - start).count(),
+        hits, misses, aligned ? "yes" : "no", correct, pooled ? "" : "  UNEXPECTED POOL USE");
+    return (padded && !aligned) || correct != 16 || !pooled;
+}
+
+int main() {
+    const precision modes[] = { precision::Double, precision::BFloat16, precision::Float16 };
+    const char* mode_names[] = { "double", "bfloat16", "float16" };
+    int failed = 0;
+    for (int m = 0; m < 3; m++) {
+        printf("%s\n", mode_names[m]);
+        std::vector<double> reference, outputs;
+        failed += run(matrix_alloc::aligned, false, modes[m], reference);
+        for (auto [alloc, padded] : { std::pair{&matrix_alloc::pool, false},
+            std::pair{&matrix_alloc::aligned, true}, std::pair{&matrix_alloc::pool, true} }) {
+            outputs.clear();
+            failed += run(*alloc, padded, modes[m], outputs);
+            bool same = outputs == reference;
+            if (!same) printf("  outputs differ from aligned storage without padding\n");
+            failed += !same;
+        }
+    }
+    Matrix::set_row_padding(false);
+    printf(failed ? "FAILED\n" : "OK\n");
+    return failed != 0;
+}
@@ -0,0 +1,163 @@
+#include <matrix.hpp>
+#include <vector>
+#include <network2.hpp>
+#include <cache.hpp>
+#include <rng.hpp>
+#include <utility>
+#include <chrono>
+#include <thread>
+#include <stdio.h>
+
+// Serves the decoder2.cpp network through an InferenceCache on a workload of
+// repeated queries, and checks that hits return exactly what the plan computes,
+// that training invalidates them, that the cache stays bounded, that entries
+// of older versions are evicted first, and that threads sharing it agree.
+
+static Matrix encode(unsigned int input) {
+    Matrix mat(0.0, 4, 1);
+    for (int j = 3; j >= 0; j--) mat.data()[3 - j] = (double)((input >> j) & 1);
+    return mat;
+}
+
+static bool same(std::span<const double> lhs, std::span<const double> rhs) {
+    if (lhs.size() != rhs.size()) return false;
+    for (size_t i = 0; i < lhs.size(); i++) if (lhs[i] != rhs[i]) return false;
+    return true;
+}
+
+int main() {
+    Network network = define_network(
+        {
+            {4, activation_fn::Null},
+            {8, activation_fn::ReLU},
+            {16, activation_fn::Softmax}
+        }, cost_fn::CrossEntropy, output_type::Dist, 2024
+    );
+
+    std::vector<std::pair<const Matrix, const Matrix>> training_data;
+    std::vector<Matrix> inputs;
+    for (unsigned int i = 0; i < 16; i++) {
+        Matrix out(0.0, 16, 1);
+        out.data()[i] = 1.0;
+        inputs.push_back(encode(i));
+        training_data.push_back({inputs.back(), out});
+    }
+    network.train(50, training_data, 3.35);
+
+    // Uncached reference results
+    Network uncached = network;
+    std::vector<std::vector<double>> expected;
+    for (const Matrix& input : inputs) {
+        std::span<const double> out = uncached.infer(input);
+        expected.push_back(std::vector<double>(out.begin(), out.end()));
+    }
+
+    const size_t queries = 200000;
+    std::vector<unsigned int> workload(queries);
+    Philox rng(7);
+    std::vector<uint64_t> draws(queries);
+    rng.fill_bits(draws);
+    for (size_t q = 0; q < queries; q++) workload[q] = (unsigned int)(draws[q] % 16);
+
+    bool ok = true;
+    network.set_inference_cache(std::make_shared<InferenceCache>(64));
+    InferenceCache& cache = *network.inference_cache();
+
+    auto time_queries = [&](Network& net) {
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned int i : workload) ok &= same(net.infer(inputs[i]), expected[i]);
+        std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+        return elapsed.count() / (double)queries;
+    };
+    double plain_us = time_queries(uncached);
+    double cached_us = time_queries(network);
+    InferenceCache::Stats stats = cache.stats();
+    printf("repeated queries: uncached %.3f us, cached %.3f us  hits %zu misses %zu  %s\n",
+        plain_us, cached_us, stats.hits, stats.misses, ok ? "ok" : "MISMATCH");
+    ok &= stats.misses == 16 && stats.hits == queries - 16;
+
+    // A training step changes the version: the next query misses and sees the new parameters
+    uint64_t before = network.version();
+    network.train(1, training_data, 3.35);
+    uncached.train(1, training_data, 3.35);
+    cache.reset_stats();
+    bool fresh = network.version() != before;
+    for (unsigned int i = 0; i < 16; i++) fresh &= same(network.infer(inputs[i]), uncached.infer(inputs[i]));
+    fresh &= cache.stats().misses == 16 && cache.stats().hits == 0;
+    for (unsigned int i = 0; i < 16; i++) fresh &= same(network.infer(inputs[i]), uncached.infer(inputs[i]));
+    fresh &= cache.stats().hits == 16;
+    printf("invalidated by train                 %s\n", fresh ? "ok" : "FAILED");
+    ok &= fresh;
+
+    // 16 inputs cycling through 8 slots: bounded, and LRU order never hits
+    Network small = uncached;
+    small.set_inference_cache(std::make_shared<InferenceCache>(8, 1));
+    for (int round = 0; round < 4; round++)
+        for (unsigned int i = 0; i < 16; i++) small.infer(inputs[i]);
+    InferenceCache::Stats bounded = small.inference_cache()->stats();
+    bool evicting = bounded.entries == 8 && bounded.hits == 0 && bounded.evictions == 64 - 8;
+    printf("bounded LRU: entries %zu evictions %zu  %s\n", bounded.entries, bounded.evictions, evicting ? "ok" : "FAILED");
+    ok &= evicting;
+
+    // Uneven split: 17 entries over 16 shards fill to exactly 17
+    InferenceCache uneven(17);
+    for (unsigned int i = 0; i < 1000; i++) {
+        double key = (double)i;
+        uneven.insert(std::span(&key, 1), 0, std::span(&key, 1));
+    }
+    bool exact = uneven.capacity() == 17 && uneven.stats().entries == 17;
+    printf("capacity 17 over 16 shards: capacity %zu entries %zu  %s\n",
+        uneven.capacity(), uneven.stats().entries, exact ? "ok" : "FAILED");
+    ok &= exact;
+
+    // Older versions are evicted before current ones, even recently used ones
+    InferenceCache versioned(4, 1);
+    std::vector<double> found;
+    auto put = [&](double key, uint64_t version) { versioned.insert(std::span(&key, 1), version, std::span(&key, 1)); };
+    auto has = [&](double key, uint64_t version) { return versioned.lookup(std::span(&key, 1), version, found); };
+    for (double key : { 1.0, 2.0, 3.0, 4.0 }) put(key, 1);
+    put(5.0, 2);
+    put(6.0, 2);
+    bool stale_first = has(3.0, 1); // Version 1 entry used after both version 2 inserts
+    put(7.0, 2);
+    put(8.0, 2);
+    for (double key : { 5.0, 6.0, 7.0, 8.0 }) stale_first &= has(key, 2);
+    stale_first &= !has(3.0, 1) && !has(4.0, 1) && versioned.stats().entries == 4;
+    printf("stale versions evicted first         %s\n", stale_first ? "ok" : "FAILED");
+    ok &= stale_first;
+
+    // A reader on an older snapshot cannot push out the current version
+    put(9.0, 1);
+    bool kept = !has(9.0, 1);
+    for (double key : { 5.0, 6.0, 7.0, 8.0 }) kept &= has(key, 2);
+    printf("older insert into a current shard    %s\n", kept ? "ok" : "FAILED");
+    ok &= kept;
+
+    // Network copies share the cache; infer itself is per copy
+    for (unsigned int i = 0; i < 16; i++) {
+        std::span<const double> out = uncached.infer(inputs[i]);
+        expected[i].assign(out.begin(), out.end());
+    }
+    cache.clear();
+    cache.reset_stats();
+    const unsigned threads = 4;
+    std::vector<Network> replicas(threads, network);
+    std::vector<char> agree(threads, 1);
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; t++) {
+        workers.emplace_back([&, t] {
+            for (size_t q = t; q < queries; q += threads)
+                agree[t] &= same(replicas[t].infer(inputs[workload[q]]), expected[workload[q]]);
+        });
+    }
+    for (auto& worker : workers) worker.join();
+    InferenceCache::Stats shared = cache.stats();
+    bool concurrent = shared.hits + shared.misses == queries && shared.misses >= 16 && shared.entries == 16;
+    for (char a : agree) concurrent &= a;
+    printf("%u threads sharing: hits %zu misses %zu  %s\n", threads, shared.hits, shared.misses, concurrent ? "ok" : "FAILED");
+    ok &= concurrent;
+
+    if (!ok) return 1;
+    printf("OK\n");
+    return 0;
+}
@@ -0,0 +1,64 @@
+#include <matrix.hpp>
+#include <vector>
+#include <network2.hpp>
+#include <functions.hpp>
+#include <utility>
+#include <cmath>
+#include <stdio.h>
+
+Matrix encode(unsigned int input) {
+    Matrix mat(0.0, 4, 1);
+    for (int j = 3; j >= 0; j--) mat.data()[3 - j] = (double)((input >> j) & 1);
+    return mat;
+}
+
+int main() {
+    // Deep, wide decoder so activation storage dominates
+    std::vector<LayerDefs> defs = {{4, activation_fn::Null}};
+    for (int i = 0; i < 16; i++) defs.push_back({64, activation_fn::ReLU});
+    defs.push_back({16, activation_fn::Softmax});
+    Network base = define_network(defs, cost_fn::CrossEntropy, output_type::Dist);
+
+    std::vector<std::pair<const Matrix, const Matrix>> training_data;
+    for (int i = 0; i < 16; i++) {
+        Matrix out(0.0, 16, 1);
+        out.data()[i] = 1.0;
+        training_data.push_back({encode(i), out});
+    }
+
+    Network reference = base;
+    reference.train(20, training_data, 0.05);
+
+    // L / k + 2k stored buffers is least near k = sqrt(L / 2)
+    const double best_every = sqrt((double)(defs.size() - 1) / 2.0);
+    size_t full_peak = 0;
+    int failed = 0;
+    for (size_t every : {0, 1, 2, 3, 4, 8}) {
+        Network network = base;
+        network.set_checkpointing(every);
+        network.reset_memory_stats();
+        network.train(20, training_data, 0.05);
+
+        // Recomputation must not change a single bit of the result
+        double diff = 0.0;
+        for (unsigned int i = 0; i < 16; i++) {
+            Matrix expected = reference.forward_prop(encode(i));
+            Matrix output = network.forward_prop(encode(i));
+            for (size_t j = 0; j < output.size(); j++)
+                diff = fmax(diff, fabs(expected.data()[j] - output.data()[j]));
+        }
+        size_t peak = network.peak_activation_bytes();
+        printf("checkpoint every %zu: peak activation memory = %zu bytes, max diff = %g\n", every, peak, diff);
+        failed += diff != 0.0;
+
+        // Any checkpointing must save memory, and k near the optimum at least half
+        if (every == 0) full_peak = peak;
+        else failed += peak >= full_peak;
+        if (fabs((double)every - best_every) <= 1.0 && 2 * peak >= full_peak) {
+            printf("  peak memory not halved near k = %.1f\n", best_every);
+            failed++;
+        }
+    }
+    printf(failed ? "FAILED\n" : "OK\n");
+    return failed != 0;
+}
@@ -0,0 +1,117 @@
+#include <matrix.hpp>
+#include <vector>
+#include <network2.hpp>
+#include <functions.hpp>
+#include <distributed.hpp>
+#include <utility>
+#include <cmath>
+#include <cstdlib>
+#include <stdio.h>
+
+#ifndef _WIN32
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+// Usage:
+//   distributed.exe [world_size]                     Launch world_size ranks on free localhost ports (POSIX)
+//   distributed.exe <world_size> <base_port> <rank>  Run a single rank listening on base_port + rank
+
+Matrix encode(unsigned int input) {
+    Matrix mat(0.0, 4, 1);
+    // int to 4-bit binary double vector e.g. 3 -> [0.0, 0.0, 1.0, 1.0]
+    for (int j = 3; j >= 0; j--) mat.data()[3 - j] = (double)((input >> j) & 1);
+    return mat;
+}
+
+// A rank that waits 10 s on a peer fails instead of hanging make check
+constexpr int timeout_ms = 10000;
+
+int run_rank(RingComm& comm) {
+    const int world_size = comm.size(), rank = comm.get_rank();
+    Network network = define_network(
+        {
+            {4, activation_fn::Null},
+            {8, activation_fn::ReLU},
+            {16, activation_fn::Softmax}
+        }, cost_fn::CrossEntropy, output_type::Dist
+    );
+
+    network.sync_parameters(comm);
+    Network reference = network;
+
+    std::vector<std::pair<const Matrix, const Matrix>> training_data, shard;
+    for (int i = 0; i < 16; i++) {
+        Matrix out(0.0, 16, 1);
+        out.data()[i] = 1.0;
+        training_data.push_back({encode(i), out});
+        if (i % world_size == rank) shard.push_back({encode(i), out});
+    }
+
+    network.train_distributed(200, shard, 0.5, comm);
+
+    // Every rank must end up with the same model
+    Matrix outputs(16, 16);
+    for (unsigned int i = 0; i < 16; i++) {
+        Matrix output = network.forward_prop(encode(i));
+        for (size_t j = 0; j < 16; j++) outputs[j][i] = output.data()[j];
+    }
+    Matrix summed = outputs;
+    comm.allreduce(summed.data());
+    double rank_diff = 0.0;
+    for (size_t i = 0; i < outputs.data().size(); i++)
+        rank_diff = fmax(rank_diff, fabs(summed.data()[i] - world_size * outputs.data()[i]));
+
+    if (rank != 0) return rank_diff < 1e-9 ? 0 : 1;
+
+    // ...and it must match single-process training on the full batch
+    reference.train(200, training_data, 0.5);
+    double ref_diff = 0.0;
+    int correct = 0;
+    for (unsigned int i = 0; i < 16; i++) {
+        Matrix output = reference.forward_prop(encode(i));
+        for (size_t j = 0; j < 16; j++) ref_diff = fmax(ref_diff, fabs(output.data()[j] - outputs[j][i]));
+        correct += nn_funcs::argmax(output) == i;
+    }
+    printf("world_size = %d\n", world_size);
+    printf("max |rank - rank0| = %g\n", rank_diff);
+    printf("max |distributed - single process| = %g\n", ref_diff);
+    printf("accuracy = %d/16\n", correct);
+    return (rank_diff < 1e-9 && ref_diff < 1e-9) ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+    int world_size = argc > 1 ? atoi(argv[1]) : 4;
+    if (argc > 3) {
+        RingComm comm(atoi(argv[3]), world_size, (uint16_t)atoi(argv[2]), timeout_ms);
+        return run_rank(comm);
+    }
+
+    #ifdef _WIN32
+    fprintf(stderr, "Launch one process per rank: distributed.exe <world_size> <base_port> <rank>\n");
+    return 1;
+    #else
+    // Bind every rank's listener to a free port first, so each child knows its neighbour's
+    std::vector<RingListener> listeners;
+    for (int rank = 0; rank < world_size; rank++) listeners.emplace_back(0);
+    for (int rank = 0; rank < world_size; rank++)
+        if (fork() == 0) {
+            uint16_t next_port = listeners[(rank + 1) % world_size].port();
+            RingListener own = std::move(listeners[rank]);
+            listeners.clear();
+            int rc;
+            {
+                RingComm comm(rank, world_size, std::move(own), next_port, timeout_ms);
+                rc = run_rank(comm);
+            }
+            fflush(stdout);
+            _exit(rc);
+        }
+    listeners.clear();
+
+    int failed = 0, status;
+    while (wait(&status) > 0) failed += !(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    printf(failed ? "FAILED (%d ranks)\n" : "OK\n", failed);
+    return failed != 0;
+    #endif
+}
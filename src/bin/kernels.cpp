@@ -0,0 +1,82 @@
+#include <kernels.hpp>
+#include <vector>
+#include <random>
+#include <cmath>
+#include <stdio.h>
+#include <chrono>
+
+// Lists the kernel variants this CPU supports, checks each against the generic
+// build and times the GEMM shapes the network hits
+
+double max_diff(const std::vector<double>& a, const std::vector<double>& b) {
+    double diff = 0.0;
+    for (size_t i = 0; i < a.size(); i++) diff = fmax(diff, fabs(a[i] - b[i]));
+    return diff;
+}
+
+int main() {
+    using namespace std::chrono;
+    std::mt19937 gen{42};
+    std::normal_distribution<double> dist{0.0, 1.0};
+    auto random_vec = [&](size_t n) {
+        std::vector<double> v(n);
+        for (double& x : v) x = dist(gen);
+        return v;
+    };
+
+    auto tables = kernels::supported();
+    const kernels::KernelTable& ref = *tables.front();
+    printf("active: %s\n", kernels::active().isa);
+
+    int failed = 0;
+    const size_t shapes[][3] = { {1, 1, 1}, {16, 8, 1}, {256, 256, 1}, {7, 13, 5}, {64, 64, 64} };
+    for (const kernels::KernelTable* table : tables) {
+        double diff = 0.0, fdiff = 0.0;
+        for (auto& shape : shapes) {
+            size_t m = shape[0], k = shape[1], n = shape[2];
+            auto a = random_vec(m * k), b = random_vec(k * n), bt = random_vec(n * k);
+            std::vector<double> out(m * n), expected(m * n);
+            table->gemm(m, k, n, a.data(), k, b.data(), n, out.data(), n);
+            ref.gemm(m, k, n, a.data(), k, b.data(), n, expected.data(), n);
+            diff = fmax(diff, max_diff(out, expected) / k);
+            table->gemm_rt(m, k, n, a.data(), k, bt.data(), k, out.data(), n);
+            ref.gemm_rt(m, k, n, a.data(), k, bt.data(), k, expected.data(), n);
+            diff = fmax(diff, max_diff(out, expected) / k);
+
+            // Float variants, against the double result of the same inputs
+            std::vector<float> fa(a.begin(), a.end()), fbt(bt.begin(), bt.end()), fout(m * n);
+            table->sgemm_rt(m, k, n, fa.data(), k, fbt.data(), k, fout.data(), n);
+            fdiff = fmax(fdiff, max_diff(std::vector<double>(fout.begin(), fout.end()), expected) / k);
+            std::vector<float> fb(b.begin(), b.end());
+            ref.gemm(m, k, n, a.data(), k, b.data(), n, expected.data(), n);
+            table->sgemm(m, k, n, fa.data(), k, fb.data(), n, fout.data(), n);
+            fdiff = fmax(fdiff, max_diff(std::vector<double>(fout.begin(), fout.end()), expected) / k);
+
+            std::vector<double> y = random_vec(m * k), y_ref = y;
+            table->axpy(-0.5, a.data(), y.data(), y.size());
+            ref.axpy(-0.5, a.data(), y_ref.data(), y_ref.size());
+            table->sigmoid(y.data(), y.data(), y.size());
+            ref.sigmoid(y_ref.data(), y_ref.data(), y_ref.size());
+            diff = fmax(diff, max_diff(y, y_ref));
+            table->dsigmoid(a.data(), y.data(), y.size());
+            ref.dsigmoid(a.data(), y_ref.data(), y_ref.size());
+            diff = fmax(diff, max_diff(y, y_ref));
+        }
+
+        auto w = random_vec(256 * 256), x = random_vec(256), c = random_vec(64 * 64);
+        std::vector<double> y(256), out(64 * 64);
+        const int reps = 2000;
+        auto start = high_resolution_clock::now();
+        for (int r = 0; r < reps; r++) table->gemm(256, 256, 1, w.data(), 256, x.data(), 1, y.data(), 1);
+        auto mid = high_resolution_clock::now();
+        for (int r = 0; r < reps / 10; r++) table->gemm(64, 64, 64, c.data(), 64, c.data(), 64, out.data(), 64);
+        auto stop = high_resolution_clock::now();
+
+        printf("%-8s max diff vs generic %.3g (float %.3g)  gemv 256x256 %.2f us  gemm 64^3 %.2f us\n", table->isa, diff, fdiff,
+            duration<double, std::micro>(mid - start).count() / reps,
+            duration<double, std::micro>(stop - mid).count() / (reps / 10));
+        failed += diff > 1e-12 || fdiff > 1e-5;
+    }
+    printf(failed ? "FAILED\n" : "OK\n");
+    return failed != 0;
+}
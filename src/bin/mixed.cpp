@@ -0,0 +1,159 @@
+#include <matrix.hpp>
+#include <vector>
+#include <network2.hpp>
+#include <functions.hpp>
+#include <precision.hpp>
+#include <utility>
+#include <chrono>
+#include <cmath>
+#include <stdio.h>
+
+// Convergence of 16-bit mixed precision training against the double path on
+// the decoder problems from decoder2.cpp and race.cpp and a wide decoder, with
+// the training time per iteration of each mode. The 16-bit modes are emulated
+// (every product rounds its operands through a scalar loop into copies, which
+// mmlt also transposes), so on the small decoders they are slower than double;
+// only the wide decoder's 256-unit layers are large enough for the float GEMMs
+// to win. Then the dynamic loss scale:
+// overflowing steps are skipped and leave the parameters alone, and clean runs
+// stop growing it at 2^24. Exits non-zero on any failure.
+
+typedef std::vector<std::pair<const Matrix, const Matrix>> Dataset;
+
+Dataset decoder_data() {
+    Dataset training_data;
+    for (int i = 0; i < 16; i++) {
+        Matrix mat(0.0, 4, 1);
+        Matrix out(0.0, 16, 1);
+        for (int j = 3; j >= 0; j--) mat.data()[3 - j] = (double)((i >> j) & 1);
+        out.data()[i] = 1.0;
+        training_data.push_back({mat, out});
+    }
+    return training_data;
+}
+
+void evaluate(Network& network, Dataset& data, bool is_softmax, double& cost, int& correct) {
+    cost = 0.0;
+    correct = 0;
+    for (size_t i = 0; i < data.size(); i++) {
+        Matrix output = network.forward_prop(data[i].first);
+        cost += is_softmax ? nn_funcs::cross_entropy(output, data[i].second)
+            : nn_funcs::squared_error(output, data[i].second);
+        correct += nn_funcs::argmax(output) == i;
+    }
+    cost /= (double)data.size();
+}
+
+// Every mode must end with all 16 correct and a cost within twice that of double
+bool compare(const char* name, const Network& base, Dataset& data, bool is_softmax,
+    int rounds, int iters_per_round, double eta) {
+    const precision modes[] = { precision::Double, precision::BFloat16, precision::Float16 };
+    const char* mode_names[] = { "double", "bfloat16", "float16" };
+
+    printf("%s\n%8s", name, "iter");
+    for (const char* mode : mode_names) printf("  %20s", mode);
+    printf("\n");
+
+    std::vector<Network> networks(3, base);
+    for (int m = 0; m < 3; m++) networks[m].set_precision(modes[m], 65536.0, 200);
+    double seconds[3] = { 0.0, 0.0, 0.0 }, final_cost[3];
+    int final_correct[3];
+
+    for (int round = 1; round <= rounds; round++) {
+        printf("%8d", round * iters_per_round);
+        for (int m = 0; m < 3; m++) {
+            auto start = std::chrono::steady_clock::now();
+            networks[m].train(iters_per_round, data, eta);
+            seconds[m] += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            double cost;
+            int correct;
+            evaluate(networks[m], data, is_softmax, cost, correct);
+            printf("  %12.6lf (%2d/16)", cost, correct);
+            final_cost[m] = cost;
+            final_correct[m] = correct;
+        }
+        printf("\n");
+    }
+    printf("%8s", "us/iter");
+    for (int m = 0; m < 3; m++) printf("  %20.2lf", seconds[m] * 1e6 / (rounds * iters_per_round));
+    printf("\n");
+    printf("final loss scale: bfloat16 = %g, float16 = %g\n\n",
+        networks[1].current_loss_scale(), networks[2].current_loss_scale());
+
+    bool ok = true;
+    for (int m = 1; m < 3; m++) ok &= std::isfinite(networks[m].current_loss_scale());
+    for (int m = 1; m < 3; m++) ok &= final_correct[m] == 16 && final_cost[m] <= 2.0 * final_cost[0];
+    if (!ok) printf("FAILED %s\n\n", name);
+    return ok;
+}
+
+bool loss_scale_check(const Network& base, Dataset& data) {
+    bool ok = true;
+    for (precision mode : { precision::BFloat16, precision::Float16 }) {
+        // Overflows the float GEMMs: skipped, the scale halves and nothing moves
+        Network overflow = base;
+        overflow.set_precision(mode, 1e300, 1);
+        Matrix before = overflow.forward_prop(data[3].first);
+        overflow.train(1, data, 0.5);
+        bool skipped = overflow.current_loss_scale() == 5e299
+            && nn_funcs::squared_error(overflow.forward_prop(data[3].first), before) == 0.0;
+
+        // Doubling after every clean step stops at 2^24. float16's narrow range
+        // overflows (and halves the scale) before that; bfloat16 reaches the cap.
+        Network growing = base;
+        growing.set_precision(mode, 1.0, 1);
+        growing.train(40, data, 0.5);
+        double scale = growing.current_loss_scale();
+        bool capped = mode == precision::BFloat16 ? scale == 16777216.0 : scale <= 16777216.0;
+
+        printf("%-8s overflow skipped: %s, loss scale after 40 clean steps: %g\n",
+            mode == precision::BFloat16 ? "bfloat16" : "float16", skipped ? "yes" : "NO", growing.current_loss_scale());
+        ok &= skipped && capped;
+    }
+    return ok;
+}
+
+int main() {
+    Dataset data = decoder_data();
+
+    Network decoder = define_network(
+        {
+            {4, activation_fn::Null},
+            {8, activation_fn::ReLU},
+            {16, activation_fn::Softmax}
+        }, cost_fn::CrossEntropy, output_type::Dist, 2024
+    );
+    bool ok = true;
+    // At decoder2.cpp's eta = 3.35 float16 is at the edge of stability: from an
+    // initial loss scale of 16 or more it stalls near cost 0.74 and 11/16 (from 1
+    // it converges), while double and bfloat16 converge either way. With a
+    // smaller step every mode converges from the default scale.
+    ok &= compare("decoder2 (cross entropy, mean cost)", decoder, data, true, 10, 50, 1.0);
+
+    Network race = define_network(
+        {
+            {4, activation_fn::Null},
+            {8, activation_fn::ReLU},
+            {30, activation_fn::ReLU},
+            {16, activation_fn::Sigmoid},
+            {16, activation_fn::Sigmoid}
+        }, cost_fn::SquaredError, output_type::Dist, 2024
+    );
+    ok &= compare("race (squared error, mean cost)", race, data, false, 10, 500, 0.78);
+
+    // Wide enough for the GEMMs to dominate the per-example rounding
+    Network wide = define_network(
+        {
+            {4, activation_fn::Null},
+            {256, activation_fn::ReLU},
+            {256, activation_fn::ReLU},
+            {16, activation_fn::Softmax}
+        }, cost_fn::CrossEntropy, output_type::Dist, 2024
+    );
+    ok &= compare("wide decoder (cross entropy, mean cost)", wide, data, true, 5, 20, 0.5);
+
+    ok &= loss_scale_check(race, data);
+
+    printf(ok ? "OK\n" : "FAILED\n");
+    return !ok;
+}
@@ -0,0 +1,106 @@
+#include <matrix.hpp>
+#include <vector>
+#include <network2.hpp>
+#include <functions.hpp>
+#include <precision.hpp>
+#include <utility>
+#include <cmath>
+#include <stdio.h>
+
+// Trains the 16-way decoder with and without batch norm on its hidden layers
+// and counts full-batch iterations until the served (folded) network gets all
+// 16 inputs right. Batch norm must never diverge and must need fewer
+// iterations in total over the seeds of every configuration. Also checks that
+// skipped mixed precision steps leave the running statistics alone.
+
+constexpr int max_iters = 2000;
+
+// Iterations to 16/16, or -1; `worst` is the highest mean served cost seen
+int iterations_to_fit(unsigned int width, bool batch_norm, double eta, uint64_t seed,
+    std::span<std::pair<const Matrix, const Matrix>> data, double& worst) {
+    Network network = define_network(
+        {
+            {4, activation_fn::Null},
+            {width, activation_fn::ReLU, 0.0, batch_norm},
+            {width, activation_fn::ReLU, 0.0, batch_norm},
+            {16, activation_fn::Softmax}
+        }, cost_fn::CrossEntropy, output_type::Dist, seed
+    );
+    worst = 0.0;
+    for (int iter = 1; iter <= max_iters; iter++) {
+        network.train(1, data, eta);
+        double cost = 0.0;
+        int correct = 0;
+        for (size_t i = 0; i < data.size(); i++) {
+            std::span<const double> out = network.infer(data[i].first);
+            size_t best = 0;
+            for (size_t k = 1; k < out.size(); k++) if (out[k] > out[best]) best = k;
+            correct += best == i;
+            cost -= log(out[i]);
+        }
+        cost /= (double)data.size();
+        if (!std::isfinite(cost)) { worst = INFINITY; return -1; }
+        worst = fmax(worst, cost);
+        if (correct == (int)data.size()) return iter;
+    }
+    return -1;
+}
+
+// A mixed precision step skipped for overflow must leave the running statistics,
+// and so every evaluation-mode output, exactly as they were
+bool skipped_step_keeps_stats(std::span<std::pair<const Matrix, const Matrix>> data) {
+    Network network = define_network(
+        {
+            {4, activation_fn::Null},
+            {16, activation_fn::ReLU, 0.0, true},
+            {16, activation_fn::Softmax}
+        }, cost_fn::CrossEntropy, output_type::Dist, 1
+    );
+    network.train(5, data, 0.5);
+    // Scaled errors overflow bfloat16, so the next step is skipped
+    network.set_precision(precision::BFloat16, 1e300, 200);
+    std::vector<Matrix> before;
+    for (auto& example : data) before.push_back(network.forward_prop(example.first));
+    network.train(1, data, 0.5);
+    bool skipped = network.current_loss_scale() < 1e300, same = true;
+    for (size_t i = 0; i < data.size(); i++) {
+        const Matrix& after = network.forward_prop(data[i].first);
+        for (size_t k = 0; k < after.row_count(); k++) same &= after[k][0] == before[i][k][0];
+    }
+    printf("skipped mixed precision step: %s, evaluation outputs unchanged: %s\n",
+        skipped ? "yes" : "no", same ? "yes" : "no");
+    return skipped && same;
+}
+
+int main() {
+    std::vector<std::pair<const Matrix, const Matrix>> data;
+    for (unsigned int i = 0; i < 16; i++) {
+        Matrix input(0.0, 4, 1), target(0.0, 16, 1);
+        for (int j = 3; j >= 0; j--) input.data()[3 - j] = (double)((i >> j) & 1);
+        target.data()[i] = 1.0;
+        data.push_back({input, target});
+    }
+
+    struct Config { unsigned int width; double eta; };
+    bool ok = true;
+    printf("width   eta   seed   plain iters (max cost)   batch norm iters (max cost)\n");
+    for (Config config : { Config{64, 0.5}, Config{64, 0.1}, Config{8, 0.5} }) {
+        int plain_total = 0, norm_total = 0;
+        for (uint64_t seed : { 1, 2, 3 }) {
+            double plain_worst, norm_worst;
+            int plain = iterations_to_fit(config.width, false, config.eta, seed, data, plain_worst);
+            int norm = iterations_to_fit(config.width, true, config.eta, seed, data, norm_worst);
+            printf("%5u  %4.2f  %5lu   %5d (%5.2f)            %5d (%5.2f)\n",
+                config.width, config.eta, (unsigned long)seed, plain, plain_worst, norm, norm_worst);
+            plain_total += plain < 0 ? max_iters : plain;
+            norm_total += norm < 0 ? max_iters : norm;
+            ok &= norm > 0 && std::isfinite(norm_worst);
+        }
+        ok &= norm_total < plain_total;
+    }
+    ok &= skipped_step_keeps_stats(data);
+
+    if (!ok) return 1;
+    printf("OK\n");
+    return 0;
+}
@@ -0,0 +1,85 @@
+#include <matrix.hpp>
+#include <vector>
+#include <network2.hpp>
+#include <utility>
+#include <cmath>
+#include <stdio.h>
+#include <chrono>
+
+Matrix encode(unsigned int input) {
+    Matrix mat(0.0, 4, 1);
+    for (int j = 3; j >= 0; j--) mat.data()[3 - j] = (double)((input >> j) & 1);
+    return mat;
+}
+
+// Checks Network::infer against forward_prop and times both
+int check(const char* name, Network network) {
+    using namespace std::chrono;
+    std::vector<std::pair<const Matrix, const Matrix>> training_data;
+    for (int i = 0; i < 16; i++) {
+        Matrix out(0.0, 16, 1);
+        out.data()[i] = 1.0;
+        training_data.push_back({encode(i), out});
+    }
+    network.train(100, training_data, 0.1);
+
+    double diff = 0.0;
+    for (unsigned int i = 0; i < 16; i++) {
+        Matrix expected = network.forward_prop(encode(i));
+        auto output = network.infer(encode(i));
+        for (size_t j = 0; j < output.size(); j++) diff = fmax(diff, fabs(output[j] - expected.data()[j]));
+    }
+
+    const int reps = 20000;
+    Matrix input = encode(7);
+    double sink = 0.0;
+    auto start = high_resolution_clock::now();
+    for (int r = 0; r < reps; r++) sink += network.forward_prop(input).data()[0];
+    auto mid = high_resolution_clock::now();
+    for (int r = 0; r < reps; r++) sink += network.infer(input)[0];
+    auto stop = high_resolution_clock::now();
+
+    const ExecutionPlan& plan = network.execution_plan();
+    printf("%s: max diff %g, scratch %zu doubles (unshared %zu), forward_prop %.3f us, infer %.3f us%s\n",
+        name, diff, plan.scratch_size(), plan.unshared_size(),
+        duration<double, std::micro>(mid - start).count() / reps,
+        duration<double, std::micro>(stop - mid).count() / reps, sink == 0.5 ? " " : "");
+    return diff > 1e-12;
+}
+
+int main() {
+    int failed = 0;
+    failed += check("decoder2", define_network(
+        {
+            {4, activation_fn::Null},
+            {8, activation_fn::ReLU},
+            {16, activation_fn::Softmax}
+        }, cost_fn::CrossEntropy, output_type::Dist
+    ));
+    failed += check("race", define_network(
+        {
+            {4, activation_fn::Null},
+            {8, activation_fn::ReLU},
+            {30, activation_fn::ReLU},
+            {16, activation_fn::Sigmoid},
+            {16, activation_fn::Sigmoid}
+        }, cost_fn::SquaredError, output_type::Dist
+    ));
+    // Batch norm and dropout fold away: infer should cost what plain race does
+    failed += check("race+norm+dropout", define_network(
+        {
+            {4, activation_fn::Null},
+            {8, activation_fn::ReLU, 0.0, true},
+            {30, activation_fn::ReLU, 0.2, true},
+            {16, activation_fn::Sigmoid, 0.2, true},
+            {16, activation_fn::Sigmoid, 0.0, true}
+        }, cost_fn::SquaredError, output_type::Dist
+    ));
+    std::vector<LayerDefs> deep = {{4, activation_fn::Null}};
+    for (int i = 0; i < 8; i++) deep.push_back({256, activation_fn::ReLU});
+    deep.push_back({16, activation_fn::Softmax});
+    failed += check("deep", define_network(deep, cost_fn::CrossEntropy, output_type::Dist));
+
+    printf(failed ? "FAILED\n" : "OK\n");
+    return failed != 0;
+}
@@ -0,0 +1,90 @@
+#include <matrix.hpp>
+#include <vector>
+#include <network2.hpp>
+#include <functions.hpp>
+#include <utility>
+#include <cmath>
+#include <stdio.h>
+#include <chrono>
+
+Matrix encode(unsigned int input) {
+    Matrix mat(0.0, 4, 1);
+    for (int j = 3; j >= 0; j--) mat.data()[3 - j] = (double)((input >> j) & 1);
+    return mat;
+}
+
+// Mean forward_prop latency over the 16 inputs in microseconds
+double latency(Network& network, const std::vector<Matrix>& inputs) {
+    using namespace std::chrono;
+    const int reps = 2000;
+    double sink = 0.0;
+    auto start = high_resolution_clock::now();
+    for (int r = 0; r < reps; r++)
+        for (const Matrix& input : inputs) sink += network.forward_prop(input).data()[0];
+    auto stop = high_resolution_clock::now();
+    if (sink == 1234.5) printf(" ");
+    return duration<double, std::micro>(stop - start).count() / (reps * inputs.size());
+}
+
+// Prunes `network` at a range of thresholds. Removing only constant neurons must
+// be exact, and small thresholds must keep every input classified correctly.
+bool prune_sweep(const char* name, Network& network, const std::vector<Matrix>& inputs) {
+    std::vector<Matrix> expected;
+    for (const Matrix& input : inputs) expected.push_back(network.forward_prop(input));
+    double base_latency = latency(network, inputs);
+
+    bool ok = true;
+    printf("%s:\n", name);
+    for (double threshold : {0.0, 1e-3, 1e-2, 1e-1, 1.0}) {
+        PruneReport report;
+        Network pruned = prune_network(network, inputs, threshold, &report);
+
+        int correct = 0;
+        double diff = 0.0;
+        for (unsigned int i = 0; i < 16; i++) {
+            Matrix output = pruned.forward_prop(inputs[i]);
+            correct += nn_funcs::argmax(output) == i;
+            for (size_t j = 0; j < output.size(); j++)
+                diff = fmax(diff, fabs(output.data()[j] - expected[i].data()[j]));
+        }
+        double pruned_latency = latency(pruned, inputs);
+
+        printf("  threshold %-6g hidden", threshold);
+        for (size_t l = 0; l < report.nodes_before.size(); l++)
+            printf(" %zu->%zu", report.nodes_before[l], report.nodes_after[l]);
+        printf("  accuracy %2d/16  max output diff %.3g  latency %.3f us -> %.3f us (%+.1f%%)\n",
+            correct, diff, base_latency, pruned_latency, 100.0 * (pruned_latency - base_latency) / base_latency);
+        if (threshold == 0.0) ok &= diff <= 1e-12;
+        if (threshold <= 1e-2) ok &= correct == 16;
+    }
+    return ok;
+}
+
+int main() {
+    std::vector<std::pair<const Matrix, const Matrix>> training_data;
+    std::vector<Matrix> inputs;
+    for (int i = 0; i < 16; i++) {
+        Matrix out(0.0, 16, 1);
+        out.data()[i] = 1.0;
+        training_data.push_back({encode(i), out});
+        inputs.push_back(encode(i));
+    }
+
+    bool ok = true;
+    for (bool batch_norm : { false, true }) {
+        Network network = define_network(
+            {
+                {4, activation_fn::Null},
+                {128, activation_fn::ReLU, 0.0, batch_norm},
+                {64, activation_fn::ReLU, 0.0, batch_norm},
+                {16, activation_fn::Softmax}
+            }, cost_fn::CrossEntropy, output_type::Dist
+        );
+        network.train(300, training_data, 0.1);
+        ok &= prune_sweep(batch_norm ? "batch norm" : "plain", network, inputs);
+    }
+
+    if (!ok) return 1;
+    printf("OK\n");
+    return 0;
+}
@@ -0,0 +1,131 @@
+#include <rng.hpp>
+#include <network2.hpp>
+#include <matrix.hpp>
+#include <vector>
+#include <random>
+#include <cmath>
+#include <stdio.h>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+
+// Checks the Philox generator against the Random123 known answers, that fills
+// are identical for any thread count and offset, and that a seed reproduces a
+// network; then times initializing a large layer against the old per-element
+// mt19937 sampling
+
+int failed = 0;
+
+void expect(bool ok, const char* what) {
+    printf("%-44s %s\n", what, ok ? "ok" : "FAILED");
+    failed += !ok;
+}
+
+int main() {
+    using namespace std::chrono;
+
+    // Random123 kat_vectors: philox4x32-10 with counter words ctr[2..3] = stream
+    Philox zero(0, 0), ones(0xFFFFFFFFFFFFFFFF, 0xFFFFFFFFFFFFFFFF);
+    auto a = zero.block(0), b = ones.block(0xFFFFFFFFFFFFFFFF);
+    expect(a[0] == 0x6627e8d5 && a[1] == 0xe169c58d && a[2] == 0xbc57ac4c && a[3] == 0x9b00dbd8
+        && b[0] == 0x408f276d && b[1] == 0x41c83b0e && b[2] == 0xa20bc7c6 && b[3] == 0x6d5451fd,
+        "known answers");
+
+    Philox gen(2024, 7);
+    const size_t n = 1 << 20;
+    std::vector<double> serial(n);
+    gen.fill_normal(serial, 0.0, 1.0, 0, 1);
+    bool same = true;
+    for (unsigned threads : { 2u, 3u, 8u, 0u }) {
+        std::vector<double> parallel(n);
+        gen.fill_normal(parallel, 0.0, 1.0, 0, threads);
+        same &= parallel == serial;
+    }
+    expect(same, "fill independent of thread count");
+
+    // A window at an odd offset is the same slice of the stream
+    std::vector<double> window(1001);
+    gen.fill_normal(window, 0.0, 1.0, 12345);
+    expect(std::equal(window.begin(), window.end(), serial.begin() + 12345), "fill at offset matches");
+
+    double mean = 0.0, var = 0.0;
+    for (double x : serial) mean += x;
+    mean /= n;
+    for (double x : serial) var += (x - mean) * (x - mean);
+    var /= n - 1;
+    printf("  mean %.5f variance %.5f\n", mean, var);
+    expect(fabs(mean) < 5.0 / sqrt(n) && fabs(var - 1.0) < 0.01, "normal moments");
+
+    std::vector<size_t> order(1000);
+    for (size_t i = 0; i < order.size(); i++) order[i] = i;
+    gen.shuffle(order);
+    std::vector<size_t> sorted = order;
+    std::sort(sorted.begin(), sorted.end());
+    bool identity = true, permutation = true;
+    for (size_t i = 0; i < order.size(); i++) identity &= order[i] == i, permutation &= sorted[i] == i;
+    expect(permutation && !identity, "shuffle is a permutation");
+
+    // Buffered draws match one-at-a-time ones
+    std::vector<uint64_t> drawn(777);
+    gen.fill_bits(drawn, 12345);
+    bool bits_match = true;
+    for (size_t i = 0; i < drawn.size(); i++) bits_match &= drawn[i] == gen.bits(12345 + i);
+    std::vector<size_t> naive(order.size());
+    for (size_t i = 0; i < naive.size(); i++) naive[i] = i;
+    for (size_t i = naive.size(); i > 1; i--) std::swap(naive[i - 1], naive[(size_t)(((unsigned __int128)gen.bits(i) * i) >> 64)]);
+    expect(bits_match && naive == order, "fill_bits and shuffle match bits()");
+
+    std::vector<LayerDefs> defs = { {64, activation_fn::Null}, {32, activation_fn::ReLU}, {10, activation_fn::Sigmoid} };
+    Network first = define_network(defs, cost_fn::SquaredError, output_type::Dist, 42);
+    Network second = define_network(defs, cost_fn::SquaredError, output_type::Dist, 42);
+    Network other = define_network(defs, cost_fn::SquaredError, output_type::Dist, 43);
+    bool equal = true, differs = false;
+    for (size_t l = 0; l < first.layer_count(); l++) {
+        for (size_t r = 0; r < first.parameters(l).weights.row_count(); r++) {
+            for (size_t c = 0; c < first.parameters(l).weights.col_count(); c++) {
+                equal &= first.parameters(l).weights[r][c] == second.parameters(l).weights[r][c];
+                differs |= first.parameters(l).weights[r][c] != other.parameters(l).weights[r][c];
+            }
+        }
+    }
+    expect(equal && differs, "seed reproduces initialization");
+    expect(first.shuffled_order(50) == second.shuffled_order(50) && first.shuffled_order(50) != first.shuffled_order(50),
+        "shuffles reproducible, fresh per call");
+
+    // Shuffled mini-batch training is reproducible end to end
+    std::vector<double> inputs(16 * 4), targets(16 * 16, 0.0);
+    for (size_t i = 0; i < 16; i++) {
+        for (size_t j = 0; j < 4; j++) inputs[i * 4 + j] = (double)((i >> (3 - j)) & 1);
+        targets[i * 16 + i] = 1.0;
+    }
+    std::vector<LayerDefs> race = { {4, activation_fn::Null}, {30, activation_fn::ReLU}, {16, activation_fn::Sigmoid} };
+    std::vector<double> outputs[2];
+    for (auto& out : outputs) {
+        Network network = define_network(race, cost_fn::SquaredError, output_type::Dist, 7);
+        network.train_sgd(300, ConstMatrixView(inputs.data(), 16, 4, 4), ConstMatrixView(targets.data(), 16, 16, 16), 4, 0.5);
+        for (size_t i = 0; i < 16; i++) {
+            Matrix& res = network.forward_prop(ConstMatrixView(inputs.data(), 16, 4, 4).row_as_col(i));
+            out.insert(out.end(), res.data().begin(), res.data().end());
+        }
+    }
+    expect(outputs[0] == outputs[1], "seeded train_sgd reproducible");
+
+    // Initialization of a 4096 x 4096 layer
+    const size_t rows = 4096, cols = 4096;
+    Matrix weights(rows, cols);
+    auto start = high_resolution_clock::now();
+    std::random_device rd{};
+    std::mt19937 mt{rd()};
+    std::normal_distribution d{0.0, sqrt(2.0 / (rows + cols))};
+    for (size_t r = 0; r < rows; r++)
+        for (double& w : weights[r]) w = d(mt);
+    auto mid = high_resolution_clock::now();
+    Layer layer(cols, rows, &gen);
+    auto stop = high_resolution_clock::now();
+    printf("  init 4096x4096: mt19937 %.1f ms, philox %.1f ms (%u threads)\n",
+        duration<double, std::milli>(mid - start).count(), duration<double, std::milli>(stop - mid).count(),
+        std::thread::hardware_concurrency());
+
+    printf(failed ? "FAILED\n" : "OK\n");
+    return failed != 0;
+}
@@ -0,0 +1,123 @@
+#include <matrix.hpp>
+#include <vector>
+#include <network2.hpp>
+#include <serving.hpp>
+#include <cache.hpp>
+#include <unordered_map>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <stdio.h>
+
+// Trains the race.cpp network (with batch norm) on one thread while readers
+// serve it through a SnapshotStore. Every result a reader gets must equal, bit
+// for bit, that of the snapshot version it pinned, versions must only move
+// forward per reader, and retired snapshots must all be freed at the end.
+
+struct Served {
+    uint64_t version;
+    unsigned int input;
+    uint64_t hash;
+};
+
+int main() {
+    using namespace std::chrono;
+
+    Network network = define_network(
+        {
+            {4, activation_fn::Null},
+            {8, activation_fn::ReLU, 0.0, true},
+            {30, activation_fn::ReLU, 0.0, true},
+            {16, activation_fn::Sigmoid},
+            {16, activation_fn::Sigmoid}
+        }, cost_fn::SquaredError, output_type::Dist, 38
+    );
+
+    std::vector<double> input_buf(16 * 4), target_buf(16 * 16, 0.0);
+    for (size_t i = 0; i < 16; i++) {
+        for (size_t j = 0; j < 4; j++) input_buf[i * 4 + j] = (double)((i >> (3 - j)) & 1);
+        target_buf[i * 16 + i] = 1.0;
+    }
+    ConstMatrixView inputs(input_buf.data(), 16, 4, 4);
+    ConstMatrixView targets(target_buf.data(), 16, 16, 16);
+
+    SnapshotStore store;
+    // Output hashes of every published version, written before it is published
+    std::unordered_map<uint64_t, std::vector<uint64_t>> expected;
+    std::vector<double> trainer_scratch;
+    auto publish = [&] {
+        std::unique_ptr<const ServingSnapshot> snapshot = make_snapshot(network);
+        std::vector<uint64_t>& hashes = expected[snapshot->version];
+        for (size_t i = 0; i < 16; i++) hashes.push_back(hash_input(snapshot->infer(inputs.row_as_col(i), trainer_scratch), 0));
+        return store.publish(std::move(snapshot));
+    };
+    publish();
+
+    // Pin overhead against the network's own infer
+    const int reps = 100000;
+    SnapshotStore::Reader timing(store);
+    auto start = steady_clock::now();
+    for (int r = 0; r < reps; r++) network.infer(inputs.row_as_col(r % 16));
+    double direct_us = duration<double, std::micro>(steady_clock::now() - start).count() / reps;
+    start = steady_clock::now();
+    for (int r = 0; r < reps; r++) timing.infer(inputs.row_as_col(r % 16));
+    double pinned_us = duration<double, std::micro>(steady_clock::now() - start).count() / reps;
+    printf("infer: network %.3f us, pinned snapshot %.3f us\n", direct_us, pinned_us);
+
+    const unsigned readers = 3;
+    const int updates = 300;
+    std::atomic<bool> training{true};
+    std::vector<std::vector<Served>> served(readers);
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < readers; t++) {
+        workers.emplace_back([&, t] {
+            SnapshotStore::Reader reader(store);
+            for (unsigned int q = t; training.load(std::memory_order_relaxed); q++) {
+                uint64_t version;
+                std::span<const double> out = reader.infer(inputs.row_as_col(q % 16), &version);
+                served[t].push_back({ version, q % 16, hash_input(out, 0) });
+            }
+        });
+    }
+
+    size_t max_retired = 0;
+    for (int u = 0; u < updates; u++) {
+        network.train_sgd(1, inputs, targets, 8, 0.78);
+        max_retired = std::max(max_retired, publish());
+    }
+    training = false;
+    for (auto& worker : workers) worker.join();
+
+    bool ok = true;
+    size_t total = 0, versions_seen = 0;
+    for (const auto& results : served) {
+        uint64_t last = 0;
+        std::vector<uint64_t> seen;
+        for (const Served& s : results) {
+            auto it = expected.find(s.version);
+            ok &= it != expected.end() && it->second[s.input] == s.hash;
+            ok &= s.version >= last;
+            if (s.version != last) seen.push_back(s.version);
+            last = s.version;
+        }
+        total += results.size();
+        versions_seen = std::max(versions_seen, seen.size());
+    }
+    size_t left = store.reclaim();
+    printf("%u readers: %zu results over up to %zu of %d versions, all consistent: %s\n",
+        readers, total, versions_seen, updates + 1, ok ? "yes" : "NO");
+    printf("retired snapshots: at most %zu waiting, %zu after readers finished\n", max_retired, left);
+    ok &= left == 0;
+
+    int correct = 0;
+    for (size_t i = 0; i < 16; i++) {
+        std::span<const double> out = timing.infer(inputs.row_as_col(i));
+        correct += (size_t)(std::max_element(out.begin(), out.end()) - out.begin()) == i;
+    }
+    printf("accuracy after online training: %d/16\n", correct);
+
+    if (!ok) return 1;
+    printf("OK\n");
+    return 0;
+}
@@ -0,0 +1,457 @@
+#include <network2.hpp>
+#include <functions.hpp>
+#include <kernels.hpp>
+#include <matrix.hpp>
+#include <vector>
+#include <random>
+#include <cmath>
+#include <cfloat>
+#include <stdlib.h>
+#include <stdio.h>
+
+// Correctness checks for the fast paths:
+//  1. finite-difference gradient check of backward_prop for every activation/cost
+//     combination define_network accepts, with and without checkpointing, and
+//     with batch norm and dropout (whose folded inference form must match)
+//  2. randomized differential tests of every kernel variant against plain loops
+//  3. the same for the Matrix operations and nn_funcs on views and padded rows
+// Usage: verify.exe [seed]. Exits non-zero on any failure.
+
+std::mt19937 gen;
+int failures = 0;
+
+double normal() { return std::normal_distribution<double>{0.0, 1.0}(gen); }
+size_t uniform(size_t lo, size_t hi) { return std::uniform_int_distribution<size_t>{lo, hi}(gen); }
+
+void check(bool ok, const char* what, double err, double tol) {
+    if (ok) return;
+    printf("  FAIL %s: error %.3g > %.3g\n", what, err, tol);
+    failures++;
+}
+
+const char* name(activation_fn fn) {
+    switch (fn) {
+        case activation_fn::Sigmoid: return "sigmoid";
+        case activation_fn::ReLU: return "relu";
+        case activation_fn::Softmax: return "softmax";
+        default: return "null";
+    }
+}
+
+// --- 1. Gradients ----------------------------------------------------------
+
+// One target per column
+Matrix random_target(size_t n, cost_fn cost, size_t batch = 1) {
+    Matrix target(n, batch);
+    for (size_t c = 0; c < batch; c++) {
+        double total = 0.0;
+        for (size_t i = 0; i < n; i++) total += target[i][c] = std::uniform_real_distribution<double>{0.05, 1.0}(gen);
+        // Cross entropy targets are distributions
+        if (cost == cost_fn::CrossEntropy) for (size_t i = 0; i < n; i++) target[i][c] /= total;
+    }
+    return target;
+}
+
+void gradient_check(activation_fn hidden, activation_fn output, cost_fn cost, bool batch_norm = false, double dropout = 0.0) {
+    const unsigned int widths[] = { 5, 7, 6, 6, 4 };
+    std::vector<LayerDefs> defs = { {widths[0], activation_fn::Null} };
+    for (size_t i = 1; i + 1 < std::size(widths); i++) defs.push_back({widths[i], hidden, dropout, batch_norm});
+    defs.push_back({widths[std::size(widths) - 1], output, 0.0, batch_norm});
+    Network network = define_network(defs, cost, output_type::Dist, gen());
+
+    // Batch norm differentiates through the statistics of the batch, so those
+    // configurations check a batch of examples side by side
+    const size_t columns = batch_norm || dropout > 0.0 ? 4 : 1;
+    Matrix input(defs.front().num_nodes, columns), target = random_target(defs.back().num_nodes, cost, columns);
+    for (size_t r = 0; r < input.row_count(); r++)
+        for (double& x : input[r]) x = normal();
+
+    double fold_diff = 0.0;
+    if (batch_norm || dropout > 0.0) {
+        // A few steps give batch norm real statistics and move gamma/beta
+        std::vector<std::pair<const Matrix, const Matrix>> batch;
+        for (int e = 0; e < 8; e++) {
+            Matrix x(defs.front().num_nodes, 1);
+            for (size_t i = 0; i < x.size(); i++) x[i][0] = normal() * 2.0 + 1.0;
+            batch.push_back({x, random_target(defs.back().num_nodes, cost)});
+        }
+        network.train(5, batch, 0.1);
+        // Evaluation mode forward_prop against the folded plan
+        const Matrix out = network.forward_prop(input);
+        for (size_t c = 0; c < columns; c++) {
+            std::span<const double> served = network.infer(ConstMatrixView(input).col_block(c, 1));
+            for (size_t i = 0; i < served.size(); i++) fold_diff = fmax(fold_diff, fabs(served[i] - out[i][c]));
+        }
+        // Check the gradient under a fixed dropout mask
+        network.set_training(true);
+    }
+
+    const std::vector<LayerParams> analytic = network.gradient(input, target);
+
+    const double h = 1e-5;
+    double worst = 0.0;
+    for (size_t l = 0; l < network.layer_count(); l++) {
+        for (int which = 0; which < 4; which++) {
+            // parameters() has to be called again before every edit
+            auto param_at = [&](size_t r, size_t c) -> double& {
+                LayerParams& params = network.parameters(l);
+                Matrix* param_of[] = { &params.weights, &params.bias, &params.gamma, &params.beta };
+                return (*param_of[which])[r][c];
+            };
+            const Matrix* grad_of[] = { &analytic[l].weights, &analytic[l].bias, &analytic[l].gamma, &analytic[l].beta };
+            const Matrix& grad = *grad_of[which];
+            for (size_t r = 0; r < grad.row_count(); r++) {
+                for (size_t c = 0; c < grad.col_count(); c++) {
+                    const double saved = param_at(r, c);
+                    param_at(r, c) = saved + h;
+                    double up = network.cost(input, target);
+                    param_at(r, c) = saved - h;
+                    double down = network.cost(input, target);
+                    param_at(r, c) = saved;
+
+                    double numeric = (up - down) / (2.0 * h), exact = grad[r][c];
+                    // Relative error, absolute below gradients of 1e-5 per example where
+                    // differencing noise dominates (batch norm makes pre-norm biases exactly 0)
+                    double err = fabs(numeric - exact) / fmax(fabs(numeric) + fabs(exact), 1e-5 * (double)columns);
+                    worst = fmax(worst, err);
+                }
+            }
+        }
+    }
+
+    // Checkpointed backward passes recompute the same values
+    network.set_checkpointing(2);
+    const std::vector<LayerParams>& recomputed = network.gradient(input, target);
+    double drift = 0.0;
+    for (size_t l = 0; l < analytic.size(); l++) {
+        for (size_t r = 0; r < analytic[l].weights.row_count(); r++)
+            for (size_t c = 0; c < analytic[l].weights.col_count(); c++)
+                drift = fmax(drift, fabs(recomputed[l].weights[r][c] - analytic[l].weights[r][c]));
+        for (size_t r = 0; r < analytic[l].bias.row_count(); r++)
+            drift = fmax(drift, fabs(recomputed[l].bias[r][0] - analytic[l].bias[r][0]));
+    }
+
+    printf("  hidden %-7s output %-7s %-13s%s%s  max rel error %.2e  checkpoint drift %.2e", name(hidden), name(output),
+        cost == cost_fn::CrossEntropy ? "cross-entropy" : "squared-error", batch_norm ? " +norm" : "",
+        dropout > 0.0 ? " +dropout" : "", worst, drift);
+    if (batch_norm || dropout > 0.0) printf("  fold diff %.2e", fold_diff);
+    printf("\n");
+    check(worst < 1e-5, "finite-difference gradient", worst, 1e-5);
+    check(drift == 0.0, "checkpointed gradient", drift, 0.0);
+    check(fold_diff <= 1e-12, "folded inference", fold_diff, 1e-12);
+}
+
+// --- 2. Kernels ------------------------------------------------------------
+
+std::vector<double> random_vec(size_t n) {
+    std::vector<double> v(n);
+    for (double& x : v) x = normal();
+    return v;
+}
+
+const double sentinel = 12345.0;
+
+// Fills the lanes between `cols` and `ld` of every row with a sentinel
+std::vector<double> output_buffer(size_t rows, size_t cols, size_t ld) {
+    std::vector<double> out(rows * ld, sentinel);
+    for (size_t r = 0; r < rows; r++)
+        for (size_t c = 0; c < cols; c++) out[r * ld + c] = 0.0;
+    return out;
+}
+
+// Largest |got - want| relative to a rounding bound of `inner` terms of size `mag`
+double gemm_error(const std::vector<double>& got, const std::vector<double>& want,
+    const std::vector<double>& mag, size_t rows, size_t cols, size_t ld, size_t inner, bool& clobbered) {
+    double err = 0.0;
+    for (size_t r = 0; r < rows; r++) {
+        for (size_t c = 0; c < ld; c++) {
+            size_t i = r * ld + c;
+            if (c >= cols) { clobbered |= got[i] != sentinel; continue; }
+            err = fmax(err, fabs(got[i] - want[i]) / ((inner + 2) * DBL_EPSILON * mag[i] + DBL_MIN));
+        }
+    }
+    return err;
+}
+
+void kernel_check(const kernels::KernelTable& table, int trials) {
+    double gemm_err = 0.0, elem_err = 0.0;
+    bool clobbered = false;
+    for (int t = 0; t < trials; t++) {
+        // Edge shapes first: matrix-vector, outer product, scalars
+        size_t m = uniform(1, 48), k = t % 5 == 1 ? 1 : uniform(1, 80), n = t % 5 == 0 ? 1 : uniform(1, 24);
+        size_t ldl = k + uniform(0, 1) * uniform(0, 9), ldo = n + uniform(0, 1) * uniform(0, 9);
+        size_t ldr = n == 1 && t % 2 ? 1 : n + uniform(0, 1) * uniform(0, 9);
+        size_t ldt = k + uniform(0, 1) * uniform(0, 9);
+        auto a = random_vec(m * ldl), b = random_vec(k * ldr), bt = random_vec(n * ldt);
+
+        std::vector<double> want(m * ldo), mag(m * ldo), want_rt(m * ldo), mag_rt(m * ldo);
+        for (size_t r = 0; r < m; r++) {
+            for (size_t c = 0; c < n; c++) {
+                double sum = 0.0, abs_sum = 0.0, sum_rt = 0.0, abs_rt = 0.0;
+                for (size_t i = 0; i < k; i++) {
+                    sum += a[r * ldl + i] * b[i * ldr + c];
+                    abs_sum += fabs(a[r * ldl + i] * b[i * ldr + c]);
+                    sum_rt += a[r * ldl + i] * bt[c * ldt + i];
+                    abs_rt += fabs(a[r * ldl + i] * bt[c * ldt + i]);
+                }
+                want[r * ldo + c] = sum, mag[r * ldo + c] = abs_sum;
+                want_rt[r * ldo + c] = sum_rt, mag_rt[r * ldo + c] = abs_rt;
+            }
+        }
+        std::vector<double> out = output_buffer(m, n, ldo);
+        table.gemm(m, k, n, a.data(), ldl, b.data(), ldr, out.data(), ldo);
+        gemm_err = fmax(gemm_err, gemm_error(out, want, mag, m, n, ldo, k, clobbered));
+        out = output_buffer(m, n, ldo);
+        table.gemm_rt(m, k, n, a.data(), ldl, bt.data(), ldt, out.data(), ldo);
+        gemm_err = fmax(gemm_err, gemm_error(out, want_rt, mag_rt, m, n, ldo, k, clobbered));
+
+        // Element-wise kernels over odd lengths to cover the vector tails
+        size_t len = uniform(1, 300);
+        auto x = random_vec(len), y = random_vec(len);
+        const double alpha = normal();
+        std::vector<double> got = y;
+        table.axpy(alpha, x.data(), got.data(), len);
+        for (size_t i = 0; i < len; i++) elem_err = fmax(elem_err, fabs(got[i] - (y[i] + alpha * x[i])) / (2 * DBL_EPSILON * (fabs(y[i]) + fabs(alpha * x[i])) + DBL_MIN));
+        got = y;
+        table.scale(alpha, got.data(), len);
+        for (size_t i = 0; i < len; i++) elem_err = fmax(elem_err, fabs(got[i] - alpha * y[i]) / (DBL_EPSILON * fabs(alpha * y[i]) + DBL_MIN));
+        got = y;
+        table.mul(x.data(), got.data(), len);
+        for (size_t i = 0; i < len; i++) elem_err = fmax(elem_err, fabs(got[i] - x[i] * y[i]) / (DBL_EPSILON * fabs(x[i] * y[i]) + DBL_MIN));
+        table.relu(x.data(), got.data(), len);
+        for (size_t i = 0; i < len; i++) elem_err = fmax(elem_err, got[i] == (x[i] > 0.0 ? x[i] : 0.0) ? 0.0 : INFINITY);
+        table.drelu(x.data(), got.data(), len);
+        for (size_t i = 0; i < len; i++) elem_err = fmax(elem_err, got[i] == (x[i] > 0.0 ? 1.0 : 0.0) ? 0.0 : INFINITY);
+        table.sigmoid(x.data(), got.data(), len);
+        for (size_t i = 0; i < len; i++) {
+            double want_sig = 1.0 / (1.0 + exp(-x[i]));
+            elem_err = fmax(elem_err, fabs(got[i] - want_sig) / (4 * DBL_EPSILON * want_sig));
+        }
+        table.dsigmoid(x.data(), got.data(), len);
+        for (size_t i = 0; i < len; i++) {
+            double want_sig = 1.0 / (1.0 + exp(-x[i]));
+            double want_dsig = want_sig * (1.0 - want_sig);
+            // 1 - sig cancels, so the bound is relative to sig rather than the product
+            elem_err = fmax(elem_err, fabs(got[i] - want_dsig) / (8 * DBL_EPSILON * want_sig));
+        }
+
+        // Batch norm of one feature over a batch, forward and backward through the batch statistics
+        const double mean = normal(), inv_std = 1.0 / (0.1 + fabs(normal())), gamma = normal(), beta = normal();
+        std::vector<double> xhat(len);
+        table.batch_norm(x.data(), len, mean, inv_std, gamma, beta, xhat.data(), got.data());
+        for (size_t i = 0; i < len; i++) {
+            double want_xhat = (x[i] - mean) * inv_std;
+            elem_err = fmax(elem_err, fabs(xhat[i] - want_xhat) / (4 * DBL_EPSILON * (fabs(x[i]) + fabs(mean)) * inv_std + DBL_MIN));
+            elem_err = fmax(elem_err, fabs(got[i] - (gamma * want_xhat + beta))
+                / (4 * DBL_EPSILON * (fabs(gamma) * (fabs(x[i]) + fabs(mean)) * inv_std + fabs(beta)) + DBL_MIN));
+        }
+        double sum = 0.0, dot = 0.0, abs_sum = 0.0, abs_dot = 0.0;
+        for (size_t i = 0; i < len; i++) {
+            sum += y[i], dot += y[i] * xhat[i];
+            abs_sum += fabs(y[i]), abs_dot += fabs(y[i] * xhat[i]);
+        }
+        double dgamma, dbeta;
+        std::vector<double> dz = y;
+        table.batch_norm_backward(dz.data(), xhat.data(), len, gamma, inv_std, &dgamma, &dbeta, dz.data());
+        // Reductions may be reordered, so the bounds scale with the batch
+        const double bound = (len + 4) * DBL_EPSILON;
+        elem_err = fmax(elem_err, fabs(dgamma - dot) / (bound * abs_dot + DBL_MIN));
+        elem_err = fmax(elem_err, fabs(dbeta - sum) / (bound * abs_sum + DBL_MIN));
+        const double scale = gamma * inv_std / (double)len;
+        for (size_t i = 0; i < len; i++) {
+            double want_dz = scale * ((double)len * y[i] - sum - xhat[i] * dot);
+            double mag = fabs(scale) * ((double)len * fabs(y[i]) + abs_sum + fabs(xhat[i]) * abs_dot);
+            elem_err = fmax(elem_err, fabs(dz[i] - want_dz) / (bound * mag + DBL_MIN));
+        }
+    }
+
+    // Philox words are integer and must match generic exactly; the polynomial
+    // Box-Muller is compared against libm
+    const kernels::KernelTable& generic = *kernels::supported().front();
+    bool words_match = true;
+    double normal_err = 0.0;
+    for (int t = 0; t < trials / 10; t++) {
+        uint64_t seed = ((uint64_t)gen() << 32) | gen(), stream = gen(), first = ((uint64_t)gen() << 30) | gen();
+        size_t count = uniform(1, 100);
+        std::vector<uint32_t> words(4 * count), want(4 * count);
+        table.philox(seed, stream, first, count, words.data());
+        generic.philox(seed, stream, first, count, want.data());
+        words_match &= words == want;
+
+        // Dropout masks are integer comparisons, so exact too
+        std::vector<double> mask(count), mask_want(count);
+        const double rate = std::uniform_real_distribution<double>{0.0, 0.9}(gen);
+        table.dropout_mask(seed, stream, first, count, rate, mask.data());
+        for (size_t i = 0; i < count; i++) {
+            uint32_t w[4];
+            generic.philox(seed, stream, (first + i) / 4, 1, w);
+            mask_want[i] = (double)w[(first + i) % 4] * 0x1p-32 >= rate ? 1.0 / (1.0 - rate) : 0.0;
+        }
+        words_match &= mask == mask_want;
+
+        std::vector<double> normals(count);
+        uint64_t begin = 2 * first + t % 2;
+        table.philox_normal(seed, stream, begin, count, 0.5, 2.0, normals.data());
+        for (size_t i = 0; i < count; i++) {
+            uint32_t w[4];
+            generic.philox(seed, stream, (begin + i) / 2, 1, w);
+            double u1 = ((double)((((uint64_t)w[0] << 32) | w[1]) >> 12) + 0.5) * 0x1p-52;
+            double u2 = ((double)((((uint64_t)w[2] << 32) | w[3]) >> 12) + 0.5) * 0x1p-52;
+            double radius = sqrt(-2.0 * log(u1)), theta = 6.283185307179586 * u2;
+            double want_normal = 0.5 + 2.0 * radius * ((begin + i) % 2 ? sin(theta) : cos(theta));
+            normal_err = fmax(normal_err, fabs(normals[i] - want_normal));
+        }
+    }
+    // Errors are in units of the rounding bound, so 1 is the tolerance
+    printf("  %-8s gemm/gemm_rt %.2f  element-wise %.2f  (x rounding bound)  normals %.1e%s%s\n", table.isa, gemm_err,
+        elem_err, normal_err, clobbered ? "  wrote past row ends" : "", words_match ? "" : "  philox mismatch");
+    check(gemm_err <= 1.0, "gemm", gemm_err, 1.0);
+    check(elem_err <= 1.0, "element-wise kernels", elem_err, 1.0);
+    check(!clobbered, "gemm row padding", 1.0, 0.0);
+    check(words_match, "philox words", 1.0, 0.0);
+    check(normal_err <= 1e-12, "philox normals", normal_err, 1e-12);
+}
+
+// --- 3. Matrix operations --------------------------------------------------
+
+Matrix random_matrix(size_t rows, size_t cols) {
+    Matrix m(rows, cols);
+    for (size_t r = 0; r < rows; r++)
+        for (double& x : m[r]) x = normal();
+    return m;
+}
+
+double max_diff(ConstMatrixView got, ConstMatrixView want) {
+    if (got.row_count() != want.row_count() || got.col_count() != want.col_count()) return INFINITY;
+    double diff = 0.0;
+    for (size_t r = 0; r < got.row_count(); r++)
+        for (size_t c = 0; c < got.col_count(); c++) diff = fmax(diff, fabs(got[r][c] - want[r][c]));
+    return diff;
+}
+
+// Padding lanes must stay zero for the contiguous fast paths
+bool padding_clean(const Matrix& m) {
+    for (size_t r = 0; r < m.row_count(); r++)
+        for (size_t c = m.col_count(); c < m.row_stride(); c++)
+            if (m.data()[r * m.row_stride() + c] != 0.0) return false;
+    return true;
+}
+
+void matrix_check(bool padded, int trials) {
+    Matrix::set_row_padding(padded);
+    double err = 0.0, half_err = 0.0;
+    bool clean = true;
+    for (int t = 0; t < trials; t++) {
+        size_t m = uniform(1, 20), k = uniform(1, 20), n = t % 3 ? uniform(1, 20) : 1;
+        // Operands are blocks of larger matrices so strides differ from widths
+        Matrix big_a = random_matrix(m + 3, k + 5), big_b = random_matrix(k + 2, n + 4), big_c = random_matrix(n + 1, k + 3);
+        ConstMatrixView a = ConstMatrixView(big_a).block(1, 2, m, k);
+        ConstMatrixView b = ConstMatrixView(big_b).block(2, 1, k, n);
+        ConstMatrixView c = ConstMatrixView(big_c).block(1, 3, n, k);
+        ConstMatrixView a2 = ConstMatrixView(big_a).block(0, 0, m, k);
+
+        // 16-bit products are checked against double products of the rounded operands
+        precision format = t % 2 ? precision::BFloat16 : precision::Float16;
+        Matrix prod(0.0, m, n), prod_rt(0.0, m, n), trans(k, m), had(m, k), sum(m, k), diff(m, k), scaled(m, k);
+        Matrix half_prod(0.0, m, n), half_prod_rt(0.0, m, n);
+        for (size_t r = 0; r < m; r++) {
+            for (size_t j = 0; j < n; j++) {
+                for (size_t i = 0; i < k; i++) {
+                    prod[r][j] += a[r][i] * b[i][j], prod_rt[r][j] += a[r][i] * c[j][i];
+                    double ra = round_to(a[r][i], format);
+                    half_prod[r][j] += ra * round_to(b[i][j], format);
+                    half_prod_rt[r][j] += ra * round_to(c[j][i], format);
+                }
+            }
+            for (size_t i = 0; i < k; i++) {
+                trans[i][r] = a[r][i];
+                had[r][i] = a[r][i] * a2[r][i];
+                sum[r][i] = a[r][i] + a2[r][i];
+                diff[r][i] = a[r][i] - a2[r][i];
+                scaled[r][i] = a[r][i] * -1.5;
+            }
+        }
+        Matrix results[] = { a * b, mmrt(a, c), transpose(a), hadamard(Matrix(a), a2), Matrix(a) + a2, Matrix(a) - a2, Matrix(a) * -1.5 };
+        const Matrix* expected[] = { &prod, &prod_rt, &trans, &had, &sum, &diff, &scaled };
+        for (size_t i = 0; i < std::size(results); i++) {
+            // Products are compared against a k-term rounding bound
+            double tol = i < 2 ? 1e-14 * (k + 2) * 16 : 0.0;
+            err = fmax(err, max_diff(results[i], *expected[i]) - tol);
+            clean &= padding_clean(results[i]);
+        }
+
+        Matrix sig = nn_funcs::sigmoid(a), dsig = nn_funcs::dsigmoid(a), rel = nn_funcs::relu(a), drel = nn_funcs::drelu(a);
+        for (size_t r = 0; r < m; r++) {
+            for (size_t i = 0; i < k; i++) {
+                double s = 1.0 / (1.0 + exp(-a[r][i]));
+                err = fmax(err, fabs(sig[r][i] - s) - 4 * DBL_EPSILON);
+                err = fmax(err, fabs(dsig[r][i] - s * (1 - s)) - 4 * DBL_EPSILON);
+                err = fmax(err, fabs(rel[r][i] - (a[r][i] > 0.0 ? a[r][i] : 0.0)));
+                err = fmax(err, fabs(drel[r][i] - (a[r][i] > 0.0 ? 1.0 : 0.0)));
+            }
+        }
+        for (const Matrix* res : { &sig, &dsig, &rel, &drel }) clean &= padding_clean(*res);
+
+        // Float accumulation over k terms of magnitude ~1
+        Matrix half_results[] = { HalfMatrix(Matrix(a), format) * b, mmlt(HalfMatrix(trans, format), b), mmrt(a, c, format) };
+        const Matrix* half_expected[] = { &half_prod, &half_prod, &half_prod_rt };
+        for (size_t i = 0; i < std::size(half_results); i++) {
+            half_err = fmax(half_err, max_diff(half_results[i], *half_expected[i]) - 1e-6 * (k + 2) * 16);
+            clean &= padding_clean(half_results[i]);
+        }
+    }
+    printf("  padding %-3s  max excess error %.2e  16-bit %.2e%s\n", padded ? "on" : "off", fmax(err, 0.0),
+        fmax(half_err, 0.0), clean ? "" : "  dirty padding");
+    check(err <= 0.0, "Matrix operations", err, 0.0);
+    check(half_err <= 0.0, "16-bit Matrix operations", half_err, 0.0);
+    check(clean, "Matrix padding", 1.0, 0.0);
+}
+
+// Edits through parameters() must reach the 16-bit weight copies: editing after
+// set_precision has to match editing before it
+void precision_edit_check(precision format) {
+    std::vector<LayerDefs> defs = {{4, activation_fn::Null}, {8, activation_fn::ReLU}, {4, activation_fn::Sigmoid}};
+    Network edited_late = define_network(defs, cost_fn::SquaredError, output_type::Dist, 7);
+    Network edited_early = define_network(defs, cost_fn::SquaredError, output_type::Dist, 7);
+    Matrix input = random_matrix(4, 1);
+    edited_late.set_precision(format);
+    edited_late.forward_prop(input);
+    for (Network* network : { &edited_late, &edited_early })
+        for (size_t l = 0; l < network->layer_count(); l++) network->parameters(l).weights *= -0.75;
+    edited_early.set_precision(format);
+    double err = max_diff(edited_late.forward_prop(input), edited_early.forward_prop(input));
+    printf("  %-8s edits after set_precision  max diff %.2e\n", format == precision::BFloat16 ? "bfloat16" : "float16", err);
+    check(err == 0.0, "16-bit weights after parameters()", err, 0.0);
+}
+
+int main(int argc, char** argv) {
+    unsigned int seed = argc > 1 ? (unsigned int)strtoul(argv[1], nullptr, 10) : 1;
+    gen.seed(seed);
+    printf("seed %u\n", seed);
+
+    printf("gradients:\n");
+    for (activation_fn hidden : { activation_fn::Null, activation_fn::Sigmoid, activation_fn::ReLU }) {
+        for (activation_fn output : { activation_fn::Null, activation_fn::Sigmoid, activation_fn::ReLU, activation_fn::Softmax }) {
+            for (cost_fn cost : { cost_fn::SquaredError, cost_fn::CrossEntropy }) {
+                // Softmax is only defined with cross entropy; cross entropy needs outputs in (0, 1)
+                bool softmax = output == activation_fn::Softmax, cross = cost == cost_fn::CrossEntropy;
+                if (softmax != cross && !(cross && output == activation_fn::Sigmoid)) continue;
+                gradient_check(hidden, output, cost);
+            }
+        }
+    }
+    gradient_check(activation_fn::ReLU, activation_fn::Sigmoid, cost_fn::SquaredError, true);
+    gradient_check(activation_fn::Sigmoid, activation_fn::Softmax, cost_fn::CrossEntropy, false, 0.3);
+    gradient_check(activation_fn::ReLU, activation_fn::Softmax, cost_fn::CrossEntropy, true, 0.3);
+
+    printf("kernels:\n");
+    for (const kernels::KernelTable* table : kernels::supported()) kernel_check(*table, 400);
+
+    printf("matrix:\n");
+    for (bool padded : { false, true }) matrix_check(padded, 200);
+    Matrix::set_row_padding(false);
+    for (precision format : { precision::BFloat16, precision::Float16 }) precision_edit_check(format);
+
+    printf(failures ? "FAILED (%d)\n" : "OK\n", failures);
+    return failures != 0;
+}
@@ -0,0 +1,69 @@
+#include <matrix.hpp>
+#include <vector>
+#include <network2.hpp>
+#include <functions.hpp>
+#include <utility>
+#include <stdio.h>
+#include <cmath>
+
+// Trains the race.cpp network straight out of caller-owned row-major buffers
+// (one example per row, records padded to 8 doubles) through MatrixViews, and
+// checks it matches training on copied Matrix pairs
+
+constexpr size_t record = 8;
+
+int main() {
+    Network network = define_network(
+        {
+            {4, activation_fn::Null},
+            {8, activation_fn::ReLU},
+            {30, activation_fn::ReLU},
+            {16, activation_fn::Sigmoid},
+            {16, activation_fn::Sigmoid}
+        }, cost_fn::SquaredError, output_type::Dist
+    );
+    Network copied = network;
+
+    // Inputs in the first 4 doubles of each record, targets one-hot
+    std::vector<double> input_buf(16 * record, -1.0), target_buf(16 * 16, 0.0);
+    for (size_t i = 0; i < 16; i++) {
+        for (size_t j = 0; j < 4; j++) input_buf[i * record + j] = (double)((i >> (3 - j)) & 1);
+        target_buf[i * 16 + i] = 1.0;
+    }
+    ConstMatrixView inputs(input_buf.data(), 16, 4, record);
+    ConstMatrixView targets(target_buf.data(), 16, 16, 16);
+
+    std::vector<std::pair<const Matrix, const Matrix>> training_data;
+    for (size_t i = 0; i < 16; i++)
+        training_data.push_back({Matrix(inputs.row_as_col(i)), Matrix(targets.row_as_col(i))});
+
+    // Two mini-batches of 8 per iteration, sliced without copying
+    for (int iter = 0; iter < 1000; iter++) {
+        for (size_t b = 0; b < 16; b += 8) {
+            network.train(1, inputs.row_block(b, 8), targets.row_block(b, 8), 0.78);
+            copied.train(1, std::span(training_data).subspan(b, 8), 0.78);
+        }
+    }
+
+    // Inference from a strided column (4 x 1, stride 16) goes through the packing path
+    std::vector<double> transposed(4 * 16);
+    for (size_t i = 0; i < 16; i++)
+        for (size_t j = 0; j < 4; j++) transposed[j * 16 + i] = inputs[i][j];
+    ConstMatrixView columns(transposed.data(), 4, 16, 16);
+
+    double max_diff = 0.0;
+    int correct = 0;
+    for (size_t i = 0; i < 16; i++) {
+        Matrix& out = network.forward_prop(inputs.row_as_col(i));
+        const Matrix& ref = copied.forward_prop(training_data[i].first);
+        for (size_t k = 0; k < out.size(); k++) max_diff = std::fmax(max_diff, std::fabs(out.data()[k] - ref.data()[k]));
+        correct += nn_funcs::argmax(out) == i;
+
+        std::span<const double> planned = network.infer(columns.col_block(i, 1));
+        for (size_t k = 0; k < planned.size(); k++) max_diff = std::fmax(max_diff, std::fabs(planned[k] - ref.data()[k]));
+    }
+    printf("views vs copies: max diff %g, accuracy %d/16\n", max_diff, correct);
+    bool ok = max_diff <= 1e-12;
+    printf(ok ? "OK\n" : "FAILED\n");
+    return !ok;
+}
@@ -0,0 +1,130 @@
+#include <cache.hpp>
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <bit>
+
+uint64_t hash_input(std::span<const double> input, uint64_t version) {
+    // One multiply per element, then the splitmix64 finalizer
+    uint64_t h = version * 0x9E3779B97F4A7C15ull ^ input.size();
+    for (double val : input) {
+        h ^= std::bit_cast<uint64_t>(val);
+        h *= 0xFF51AFD7ED558CCDull;
+        h ^= h >> 32;
+    }
+    h ^= h >> 30; h *= 0xBF58476D1CE4E5B9ull;
+    h ^= h >> 27; h *= 0x94D049BB133111EBull;
+    return h ^ (h >> 31);
+}
+
+static bool same_bits(std::span<const double> lhs, const std::vector<double>& rhs) {
+    return lhs.size() == rhs.size() && std::memcmp(lhs.data(), rhs.data(), lhs.size_bytes()) == 0;
+}
+
+InferenceCache::InferenceCache(size_t capacity, size_t shards) {
+    assert(capacity > 0 && shards > 0 && "InferenceCache: capacity and shard count must be positive");
+    shard_count = std::min(shards, capacity);
+    total_capacity = capacity;
+    this->shards = std::make_unique<Shard[]>(shard_count);
+    // The first capacity % shard_count shards take the remainder, so the shards sum to capacity
+    for (size_t s = 0; s < shard_count; s++)
+        this->shards[s].capacity = capacity / shard_count + (s < capacity % shard_count);
+}
+
+// Multiply-shift maps the key's high bits onto a shard
+InferenceCache::Shard& InferenceCache::shard_for(uint64_t key) const {
+    return shards[(size_t)(((unsigned __int128)key * shard_count) >> 64)];
+}
+
+// Entries of a version newer than any seen before retire the current ones to `stale`
+std::list<InferenceCache::Entry>& InferenceCache::Shard::list_for(uint64_t version) {
+    if (version > newest) {
+        stale.splice(stale.begin(), lru);
+        newest = version;
+    }
+    return version == newest ? lru : stale;
+}
+
+bool InferenceCache::lookup(std::span<const double> input, uint64_t version, std::vector<double>& output) {
+    uint64_t key = hash_input(input, version);
+    Shard& shard = shard_for(key);
+    {
+        std::lock_guard guard(shard.lock);
+        auto it = shard.index.find(key);
+        if (it != shard.index.end() && it->second->version == version && same_bits(input, it->second->input)) {
+            std::list<Entry>& list = version == shard.newest ? shard.lru : shard.stale;
+            list.splice(list.begin(), list, it->second);
+            output = it->second->output;
+            hits.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    misses.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+void InferenceCache::insert(std::span<const double> input, uint64_t version, std::span<const double> output) {
+    uint64_t key = hash_input(input, version);
+    Shard& shard = shard_for(key);
+    std::lock_guard guard(shard.lock);
+
+    std::list<Entry>& list = shard.list_for(version);
+
+    // A colliding key keeps only the newest entry
+    auto it = shard.index.find(key);
+    if (it != shard.index.end()) {
+        Entry& entry = *it->second;
+        if (version < entry.version) return;
+        std::list<Entry>& from = entry.version == shard.newest ? shard.lru : shard.stale;
+        entry.version = version;
+        entry.input.assign(input.begin(), input.end());
+        entry.output.assign(output.begin(), output.end());
+        list.splice(list.begin(), from, it->second);
+        return;
+    }
+
+    if (shard.lru.size() + shard.stale.size() >= shard.capacity) {
+        // An older version never displaces the newest one's entries
+        if (version < shard.newest && shard.stale.empty()) return;
+        // Stale versions go first; reuse the evicted entry's buffers
+        std::list<Entry>& victims = shard.stale.empty() ? shard.lru : shard.stale;
+        auto last = std::prev(victims.end());
+        shard.index.erase(last->key);
+        list.splice(list.begin(), victims, last);
+        evictions.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        list.emplace_front();
+    }
+    Entry& entry = list.front();
+    entry.key = key;
+    entry.version = version;
+    entry.input.assign(input.begin(), input.end());
+    entry.output.assign(output.begin(), output.end());
+    shard.index[key] = list.begin();
+}
+
+void InferenceCache::clear() {
+    for (size_t s = 0; s < shard_count; s++) {
+        std::lock_guard guard(shards[s].lock);
+        shards[s].lru.clear();
+        shards[s].stale.clear();
+        shards[s].index.clear();
+    }
+}
+
+InferenceCache::Stats InferenceCache::stats() const {
+    size_t entries = 0;
+    for (size_t s = 0; s < shard_count; s++) {
+        std::lock_guard guard(shards[s].lock);
+        entries += shards[s].lru.size() + shards[s].stale.size();
+    }
+    return { hits.load(), misses.load(), evictions.load(), entries };
+}
+
+void InferenceCache::reset_stats() {
+    hits = 0;
+    misses = 0;
+    evictions = 0;
+}
+
+size_t InferenceCache::capacity() const { return total_capacity; }
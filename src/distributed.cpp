@@ -0,0 +1,228 @@
+#include <distributed.hpp>
+#include <cassert>
+#include <cstdlib>
+#include <chrono>
+#include <stdio.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef SOCKET sock_t;
+typedef int ssize_t;
+#define poll WSAPoll
+static void close_sock(sock_t s) { closesocket(s); }
+static void set_nonblocking(sock_t s) { u_long on = 1; ioctlsocket(s, FIONBIO, &on); }
+static bool would_block() { return WSAGetLastError() == WSAEWOULDBLOCK; }
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+typedef int sock_t;
+static void close_sock(sock_t s) { close(s); }
+static void set_nonblocking(sock_t s) { fcntl(s, F_SETFL, fcntl(s, F_GETFL, 0) | O_NONBLOCK); }
+static bool would_block() { return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR; }
+#endif
+
+// Socket failures leave the ring in an unrecoverable state, so bail out the
+// same way a failed assert would.
+[[noreturn]] static void comm_fail(const char* what) {
+    perror(what);
+    std::abort();
+}
+
+static sockaddr_in loopback(uint16_t port) {
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    return addr;
+}
+
+RingListener::RingListener(uint16_t port) {
+    #ifdef _WIN32
+    WSADATA wsa;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) comm_fail("WSAStartup");
+    #endif
+    sock_t listener = socket(AF_INET, SOCK_STREAM, 0);
+    int on = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, (const char*)&on, sizeof(on));
+    sockaddr_in addr = loopback(port);
+    if (bind(listener, (sockaddr*)&addr, sizeof(addr)) != 0) comm_fail("RingListener bind");
+    if (listen(listener, 1) != 0) comm_fail("RingListener listen");
+    socklen_t len = sizeof(addr);
+    if (getsockname(listener, (sockaddr*)&addr, &len) != 0) comm_fail("RingListener getsockname");
+    sock = (intptr_t)listener;
+    bound_port = ntohs(addr.sin_port);
+}
+
+RingListener::RingListener(RingListener&& other) noexcept : sock(other.sock), bound_port(other.bound_port) {
+    other.sock = -1;
+}
+
+RingListener::~RingListener() {
+    if (sock == -1) return;
+    close_sock((sock_t)sock);
+    #ifdef _WIN32
+    WSACleanup();
+    #endif
+}
+
+uint16_t RingListener::port() const { return bound_port; }
+
+RingComm::RingComm(int rank, int world_size, uint16_t base_port, int timeout_ms)
+    : rank(rank), world_size(world_size), timeout_ms(timeout_ms) {
+    assert(world_size >= 1 && rank >= 0 && rank < world_size && "RingComm: invalid rank");
+    worker = std::thread(&RingComm::worker_loop, this);
+    if (world_size == 1) return;
+    RingListener listener(base_port + rank);
+    connect_ring(listener, base_port + (rank + 1) % world_size);
+}
+
+RingComm::RingComm(int rank, int world_size, RingListener listener, uint16_t next_port, int timeout_ms)
+    : rank(rank), world_size(world_size), timeout_ms(timeout_ms) {
+    assert(world_size >= 1 && rank >= 0 && rank < world_size && "RingComm: invalid rank");
+    worker = std::thread(&RingComm::worker_loop, this);
+    if (world_size == 1) return;
+    connect_ring(listener, next_port);
+}
+
+void RingComm::connect_ring(RingListener& listener, uint16_t next_port) {
+    #ifdef _WIN32
+    WSADATA wsa;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) comm_fail("WSAStartup");
+    #endif
+
+    // The next rank may not be listening yet; keep retrying until the timeout
+    sock_t next = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in next_addr = loopback(next_port);
+    int attempts = 0;
+    while (connect(next, (sockaddr*)&next_addr, sizeof(next_addr)) != 0) {
+        if (++attempts * 10 > timeout_ms) comm_fail("RingComm connect");
+        close_sock(next);
+        next = socket(AF_INET, SOCK_STREAM, 0);
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    pollfd pending = { (sock_t)listener.sock, POLLIN, 0 };
+    int ready = poll(&pending, 1, timeout_ms);
+    if (ready == 0) { fprintf(stderr, "RingComm accept: timed out\n"); std::abort(); }
+    if (ready < 0) comm_fail("RingComm accept");
+    sock_t prev = accept((sock_t)listener.sock, nullptr, nullptr);
+    if (prev == (sock_t)-1) comm_fail("RingComm accept");
+
+    int on = 1;
+    setsockopt(next, IPPROTO_TCP, TCP_NODELAY, (const char*)&on, sizeof(on));
+    set_nonblocking(next);
+    set_nonblocking(prev);
+    next_sock = (intptr_t)next;
+    prev_sock = (intptr_t)prev;
+}
+
+RingComm::~RingComm() {
+    {
+        std::lock_guard<std::mutex> guard(queue_lock);
+        stopping = true;
+    }
+    queue_cv.notify_all();
+    worker.join();
+    if (world_size == 1) return;
+    close_sock((sock_t)next_sock);
+    close_sock((sock_t)prev_sock);
+    #ifdef _WIN32
+    WSACleanup();
+    #endif
+}
+
+int RingComm::get_rank() const { return rank; }
+int RingComm::size() const { return world_size; }
+
+// Sends `out` to the next rank while receiving `in` from the previous one.
+// Both directions progress together so neither side can stall on a full socket buffer.
+void RingComm::send_recv(std::span<const double> out, std::span<double> in) {
+    const char* send_ptr = (const char*)out.data();
+    char* recv_ptr = (char*)in.data();
+    size_t to_send = out.size_bytes(), to_recv = in.size_bytes();
+
+    while (to_send > 0 || to_recv > 0) {
+        pollfd fds[2] = {
+            { (sock_t)next_sock, (short)(to_send > 0 ? POLLOUT : 0), 0 },
+            { (sock_t)prev_sock, (short)(to_recv > 0 ? POLLIN : 0), 0 },
+        };
+        int ready = poll(fds, 2, timeout_ms);
+        if (ready == 0) { fprintf(stderr, "RingComm: no progress from a peer in %d ms\n", timeout_ms); std::abort(); }
+        if (ready < 0) {
+            if (would_block()) continue;
+            comm_fail("RingComm poll");
+        }
+        if (to_send > 0 && (fds[0].revents & (POLLOUT | POLLERR | POLLHUP))) {
+            ssize_t n = send((sock_t)next_sock, send_ptr, to_send, 0);
+            if (n < 0 && !would_block()) comm_fail("RingComm send");
+            if (n > 0) { send_ptr += n; to_send -= n; }
+        }
+        if (to_recv > 0 && (fds[1].revents & (POLLIN | POLLERR | POLLHUP))) {
+            ssize_t n = recv((sock_t)prev_sock, recv_ptr, to_recv, 0);
+            if (n == 0) { fprintf(stderr, "RingComm recv: peer closed\n"); std::abort(); }
+            if (n < 0 && !would_block()) comm_fail("RingComm recv");
+            if (n > 0) { recv_ptr += n; to_recv -= n; }
+        }
+    }
+}
+
+void RingComm::ring_allreduce(std::span<double> buf) {
+    if (world_size == 1 || buf.empty()) return;
+    const size_t n = world_size;
+    auto chunk = [&](size_t i) {
+        i %= n;
+        size_t begin = buf.size() * i / n, end = buf.size() * (i + 1) / n;
+        return buf.subspan(begin, end - begin);
+    };
+
+    // Reduce-scatter: after N - 1 steps rank r holds the full sum of chunk r + 1
+    for (size_t step = 0; step < n - 1; step++) {
+        auto out = chunk(rank + n - step), acc = chunk(rank + n - step - 1);
+        recv_buf.resize(acc.size());
+        send_recv(out, recv_buf);
+        for (size_t i = 0; i < acc.size(); i++) acc[i] += recv_buf[i];
+    }
+    // All-gather: pass the reduced chunks around the ring
+    for (size_t step = 0; step < n - 1; step++)
+        send_recv(chunk(rank + n - step + 1), chunk(rank + n - step));
+}
+
+void RingComm::allreduce(std::span<double> buf) {
+    allreduce_async(buf);
+    wait();
+}
+
+void RingComm::allreduce_async(std::span<double> buf) {
+    {
+        std::lock_guard<std::mutex> guard(queue_lock);
+        queue.push_back(buf);
+        in_flight++;
+    }
+    queue_cv.notify_all();
+}
+
+void RingComm::wait() {
+    std::unique_lock<std::mutex> guard(queue_lock);
+    queue_cv.wait(guard, [this] { return in_flight == 0; });
+}
+
+void RingComm::worker_loop() {
+    std::unique_lock<std::mutex> guard(queue_lock);
+    while (true) {
+        queue_cv.wait(guard, [this] { return stopping || !queue.empty(); });
+        if (queue.empty()) return;
+        auto buf = queue.front();
+        queue.pop_front();
+        guard.unlock();
+        ring_allreduce(buf);
+        guard.lock();
+        in_flight--;
+        queue_cv.notify_all();
+    }
+}
@@ -1,90 +1,93 @@
 #include <functions.hpp>
+#include <kernels.hpp>
 #include <cmath>
 #include <cassert>
 
+// Applies an element-wise kernel, row by row on padded matrices so the padding
+// lanes stay zero
+static Matrix map_rows(ConstMatrixView m, void (*kernel)(const double*, double*, size_t)) {
+    Matrix res(m.row_count(), m.col_count());
+    if (m.is_contiguous() && res.row_stride() == res.col_count()) kernel(m.row_ptr(0), res.data().data(), m.size());
+    else for (size_t r = 0; r < m.row_count(); r++) kernel(m.row_ptr(r), res[r].data(), m.col_count());
+    return res;
+}
+
 namespace nn_funcs {
-    Matrix sigmoid(const Matrix& m) {
-        Matrix res(m.row_count(), m.col_count());
-        for (size_t i = 0; i < m.size(); i++) 
-            res.data()[i] = 1.0 / (1.0 + exp(-m.data()[i]));
-        
-        return res;
+    Matrix sigmoid(ConstMatrixView m) {
+        return map_rows(m, kernels::active().sigmoid);
     }
-    Matrix dsigmoid(const Matrix& m) {
-        Matrix res(m.row_count(), m.col_count());
-        double sig;
-        for (size_t i = 0; i < m.size(); i++) {
-            sig = 1.0 / (1.0 + exp(-m.data()[i]));
-            res.data()[i] = sig * (1 - sig);
-        }
-        return res;
+    Matrix dsigmoid(ConstMatrixView m) {
+        return map_rows(m, kernels::active().dsigmoid);
     }
 
-    Matrix softmax(const Matrix& m) {
-        assert(m.col_count() == 1 && "softmax expects a column vector");
+    // Per column, so a batch of examples side by side normalizes each on its own
+    Matrix softmax(ConstMatrixView m) {
         Matrix res(m.row_count(), m.col_count());
-        double sum = 0.0;
-        double max_val = m.data()[argmax(m)];
-        for (size_t i = 0; i < m.data().size(); i++) 
-            sum += exp(m.data()[i] - max_val);
-
-        for (size_t i = 0; i < m.data().size(); i++) 
-            res.data()[i] = exp(m.data()[i] - max_val) / sum;
+        for (size_t c = 0; c < m.col_count(); c++) {
+            double sum = 0.0, max_val = -INFINITY;
+            for (size_t i = 0; i < m.row_count(); i++) max_val = fmax(max_val, m[i][c]);
+            for (size_t i = 0; i < m.row_count(); i++) 
+                sum += exp(m[i][c] - max_val);
 
+            for (size_t i = 0; i < m.row_count(); i++) 
+                res[i][c] = exp(m[i][c] - max_val) / sum;
+        }
         return res;
     }
-    Matrix dsoftmax(const Matrix& m) { return m; }
+    Matrix dsoftmax(ConstMatrixView m) { return Matrix(m); }
 
-    size_t argmax(const Matrix& m) {
+    size_t argmax(ConstMatrixView m) {
         assert(m.col_count() == 1 && "argmax expects a column vector");
         double max = -INFINITY;
         size_t max_idx = 0;
         for (size_t i = 0; i < m.size(); i++) {
-            if (m.data()[i] >= max) { 
-                max = m.data()[i];
+            if (m[i][0] >= max) { 
+                max = m[i][0];
                 max_idx = i;
             }
         }
         return max_idx;
     }
 
-    Matrix relu(const Matrix& m) {
-        Matrix res(0.0, m.row_count(), m.col_count());
-        for (size_t i = 0; i < m.size(); i++) res.data()[i] = __max(m.data()[i], 0.0);
-        return res;
+    Matrix relu(ConstMatrixView m) {
+        return map_rows(m, kernels::active().relu);
     }
 
-    Matrix drelu(const Matrix& m) {
-        Matrix res(0.0, m.row_count(), m.col_count());
-        for (size_t i = 0; i < m.size(); i++) res.data()[i] = (double)(m.data()[i] > 0.0);
-        return res;
+    Matrix drelu(ConstMatrixView m) {
+        return map_rows(m, kernels::active().drelu);
     }
 
-    double cross_entropy(const Matrix& y1, const Matrix& y2) {
-        assert(y1.row_count() == y2.row_count() && (y1.col_count() == 1) && "cross_entropy expects a column vector");
+    Matrix identity(ConstMatrixView m) { return Matrix(m); }
+    Matrix didentity(ConstMatrixView m) { return Matrix(1.0, m.row_count(), m.col_count()); }
+
+    // Summed over the columns of a batch
+    double cross_entropy(ConstMatrixView y1, ConstMatrixView y2) {
+        assert(y1.row_count() == y2.row_count() && y1.col_count() == y2.col_count() && "cross_entropy: shape mismatch");
         
         double sum = 0.0;
-        for (size_t i = 0; i < y1.row_count(); i++) sum -= y2.data()[i] * log(y1.data()[i]);
+        for (size_t i = 0; i < y1.row_count(); i++)
+            for (size_t c = 0; c < y1.col_count(); c++) sum -= y2[i][c] * log(y1[i][c]);
     
         return sum;
     }
 
-    Matrix dcross_entropy(const Matrix& y1, const Matrix& y2) {
-        assert(y1.row_count() == y2.row_count() && (y1.col_count() == 1) && "dcross_entropy expects a column vector");
+    Matrix dcross_entropy(ConstMatrixView y1, ConstMatrixView y2) {
+        assert(y1.row_count() == y2.row_count() && y1.col_count() == y2.col_count() && "dcross_entropy: shape mismatch");
 
         Matrix res(0.0, y1.row_count(), y1.col_count());
-        for (size_t i = 0; i < y1.row_count(); i++) res.data()[i] = -y2.data()[i] / (y1.data()[i] + 1e-9);
+        for (size_t i = 0; i < y1.row_count(); i++)
+            for (size_t c = 0; c < y1.col_count(); c++) res[i][c] = -y2[i][c] / (y1[i][c] + 1e-9);
         return res;
     }
 
-    double squared_error(const Matrix& y1, const Matrix& y2) {
-        Matrix res = y1 - y2;
+    double squared_error(ConstMatrixView y1, ConstMatrixView y2) {
+        Matrix res = Matrix(y1) - y2;
         double sum = 0.0;
         for (double err : res.data()) sum += err * err;
         return sum;
     }
 
-    Matrix dsquared_error(const Matrix& y1, const Matrix& y2) {
-        return (y1 - y2) * 2.0;
+    Matrix dsquared_error(ConstMatrixView y1, ConstMatrixView y2) {
+        return (Matrix(y1) - y2) * 2.0;
     }
 }
\ No newline at end of file
@@ -0,0 +1,77 @@
+#include <kernels.hpp>
+#include <cmath>
+#include <bit>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <stdio.h>
+
+namespace generic {
+    #define KERNEL_ISA "generic"
+    #include "kernels.inc"
+    #undef KERNEL_ISA
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#define NN_X86_DISPATCH
+
+#pragma GCC push_options
+#pragma GCC target("sse4.2")
+namespace sse42 {
+    #define KERNEL_ISA "sse4.2"
+    #include "kernels.inc"
+    #undef KERNEL_ISA
+}
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+namespace avx2 {
+    #define KERNEL_ISA "avx2"
+    #include "kernels.inc"
+    #undef KERNEL_ISA
+}
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx2,fma")
+namespace avx512 {
+    #define KERNEL_ISA "avx512"
+    #include "kernels.inc"
+    #undef KERNEL_ISA
+}
+#pragma GCC pop_options
+#endif
+
+namespace kernels {
+    static std::vector<const KernelTable*> detect() {
+        std::vector<const KernelTable*> tables = { &generic::table };
+        #ifdef NN_X86_DISPATCH
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("sse4.2")) tables.push_back(&sse42::table);
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) tables.push_back(&avx2::table);
+        if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+            tables.push_back(&avx512::table);
+        #endif
+        return tables;
+    }
+
+    std::span<const KernelTable* const> supported() {
+        static const std::vector<const KernelTable*> tables = detect();
+        return tables;
+    }
+
+    const KernelTable& active() {
+        static const KernelTable* selected = [] {
+            auto tables = supported();
+            const char* forced = getenv("NN_KERNELS");
+            if (!forced) return tables.back();
+            for (const KernelTable* table : tables)
+                if (strcmp(table->isa, forced) == 0) return table;
+            fprintf(stderr, "NN_KERNELS=%s is not supported on this CPU, using %s\n", forced, tables.back()->isa);
+            return tables.back();
+        }();
+        return *selected;
+    }
+}
@@ -1,28 +1,56 @@
 #include "matrix.hpp"
+#include <kernels.hpp>
 #include <cassert>
 #include <algorithm>
+#include <atomic>
 #include <stdio.h>
 
+// Only read when a Matrix is created; each Matrix keeps its own stride
+static std::atomic<bool> pad_rows{false};
+
+static size_t row_stride_for(size_t cols) {
+    return (pad_rows.load(std::memory_order_relaxed) && cols > 1) ? (cols + 7) / 8 * 8 : cols;
+}
+
+void Matrix::set_row_padding(bool enabled) { pad_rows.store(enabled, std::memory_order_relaxed); }
+
 Matrix::Matrix(size_t rows, size_t cols) 
-    : rows(rows), cols(cols), length(rows * cols), 
-    _data(length) {}
+    : rows(rows), cols(cols), length(rows * cols), stride(row_stride_for(cols)),
+    _data(rows * stride) {}
 
 Matrix::Matrix(double val, size_t rows, size_t cols) 
-    : rows(rows), cols(cols), length(rows * cols), 
-    _data(length, val) {}
+    : rows(rows), cols(cols), length(rows * cols), stride(row_stride_for(cols)),
+    _data(rows * stride, val) {
+    // Keep padding lanes zero
+    if (stride != cols) for (size_t r = 0; r < rows; r++)
+        std::fill(_data.begin() + r * stride + cols, _data.begin() + (r + 1) * stride, 0.0);
+}
 
 Matrix::Matrix(size_t cols, std::initializer_list<double> init)
-    : rows(init.size() / cols), cols(cols), length(init.size()),
-    _data(init) {
+    : rows(init.size() / cols), cols(cols), length(init.size()), stride(row_stride_for(cols)),
+    _data(rows * stride) {
     assert(init.size() % cols == 0 && "initializer list size must be multiple of cols");
+    for (size_t r = 0; r < rows; r++)
+        std::copy(init.begin() + r * cols, init.begin() + (r + 1) * cols, _data.begin() + r * stride);
+}
+
+Matrix::Matrix(ConstMatrixView view)
+    : rows(view.row_count()), cols(view.col_count()), length(rows * cols), stride(row_stride_for(cols)),
+    _data(rows * stride) {
+    for (size_t r = 0; r < rows; r++) std::copy(view[r].begin(), view[r].end(), _data.begin() + r * stride);
 }
 
+Matrix::operator ConstMatrixView() const { return view(); }
+Matrix::operator MatrixView() { return view(); }
+ConstMatrixView Matrix::view() const { return ConstMatrixView(_data.data(), rows, cols, stride); }
+MatrixView Matrix::view() { return MatrixView(_data.data(), rows, cols, stride); }
+
 std::span<double> Matrix::operator[](size_t row) {
-    return std::span(_data.begin() + cols * row, cols);
+    return std::span(_data.begin() + stride * row, cols);
 }
 
 std::span<const double> Matrix::operator[](size_t row) const {
-    return std::span(_data.begin() + cols * row, cols);
+    return std::span(_data.begin() + stride * row, cols);
 }
 
 std::span<double> Matrix::data() { return _data; }
@@ -32,105 +60,96 @@ std::span<const double> Matrix::data() const { return _data; }
 size_t Matrix::row_count() const { return rows; }
 size_t Matrix::col_count() const { return cols; }
 size_t Matrix::size() const { return length; }
+size_t Matrix::row_stride() const { return stride; }
 
-Matrix transpose(Matrix mat) {
-    Matrix res(mat.cols, mat.rows);
+Matrix transpose(ConstMatrixView mat) {
+    Matrix res(mat.col_count(), mat.row_count());
 
-    for (size_t j = 0; j < mat.rows; j++)
-        for (size_t i = 0; i < mat.cols; i++)
+    for (size_t j = 0; j < mat.row_count(); j++)
+        for (size_t i = 0; i < mat.col_count(); i++)
             res[i][j] = mat[j][i];
 
     return res;
 }
 
-Matrix hadamard(Matrix lhs, const Matrix& rhs) {
-    assert(lhs.rows == rhs.rows && rhs.cols == rhs.cols && "Hadamard requires matrix dimensions to be the same");
-    for (size_t i = 0; i < lhs.size(); i++) lhs._data[i] *= rhs._data[i];
-    return Matrix(lhs);
+Matrix hadamard(Matrix lhs, ConstMatrixView rhs) {
+    MatrixView out = lhs;
+    assert(out.row_count() == rhs.row_count() && out.col_count() == rhs.col_count() && "Hadamard requires matrix dimensions to be the same");
+    if (out.is_contiguous() && rhs.is_contiguous())
+        kernels::active().mul(rhs.row_ptr(0), out.row_ptr(0), out.size());
+    else for (size_t r = 0; r < out.row_count(); r++)
+        kernels::active().mul(rhs.row_ptr(r), out.row_ptr(r), out.col_count());
+    return lhs;
 }
 
-Matrix& Matrix::operator+=(const Matrix& rhs) {
-    assert(rows == rhs.rows && cols == rhs.cols);
-    for (size_t i = 0; i < length; i++) _data[i] += rhs._data[i];
+// this += alpha * rhs, row by row unless both sides are contiguous
+void Matrix::axpy(double alpha, ConstMatrixView rhs) {
+    assert(rows == rhs.row_count() && cols == rhs.col_count());
+    if (stride == cols && rhs.is_contiguous())
+        kernels::active().axpy(alpha, rhs.row_ptr(0), _data.data(), length);
+    else for (size_t r = 0; r < rows; r++)
+        kernels::active().axpy(alpha, rhs.row_ptr(r), (*this)[r].data(), cols);
+}
+
+Matrix& Matrix::operator+=(ConstMatrixView rhs) {
+    axpy(1.0, rhs);
     return *this;
 }
-Matrix operator+(Matrix lhs, const Matrix& rhs) {
+Matrix operator+(Matrix lhs, ConstMatrixView rhs) {
     lhs += rhs;
-    return Matrix(lhs);
+    return lhs;
 }
 
-Matrix& Matrix::operator-=(const Matrix& rhs) {
-    assert(rows == rhs.rows && cols == rhs.cols);
-    for (size_t i = 0; i < length; i++) _data[i] -= rhs._data[i];
+Matrix& Matrix::operator-=(ConstMatrixView rhs) {
+    axpy(-1.0, rhs);
     return *this;
 }
-Matrix operator-(Matrix lhs, const Matrix& rhs) {
+Matrix operator-(Matrix lhs, ConstMatrixView rhs) {
     lhs -= rhs;
-    return Matrix(lhs);
+    return lhs;
 }
 
 Matrix& Matrix::operator*=(double scalar) {
-    for (size_t i = 0; i < length; i++) _data[i] *= scalar;
+    kernels::active().scale(scalar, _data.data(), _data.size());
     return *this;
 }
 Matrix operator*(Matrix lhs, double scalar) {
     lhs *= scalar;
-    return Matrix(lhs);
+    return lhs;
 }
 
-Matrix& Matrix::operator*=(const Matrix& rhs) {
+Matrix& Matrix::operator*=(ConstMatrixView rhs) {
     *this = (*this * rhs);
     return *this;
 }
 
-Matrix operator*(const Matrix& lhs, const Matrix& rhs) {
-    assert(lhs.cols == rhs.rows);
-    Matrix result(lhs.rows, rhs.cols);
-
-    for (size_t row = 0; row < lhs.rows; row++) {
-        auto result_row = result[row];
-        for (size_t col = 0; col < rhs.cols; col++) {
-            double sum = 0;
-            auto left_row = lhs[row];
-            for (size_t k = 0; k < lhs.cols; k++) {
-                sum += left_row[k] * rhs[k][col];
-            }
-            result_row[col] = sum;
-        }
-    }
+Matrix operator*(ConstMatrixView lhs, ConstMatrixView rhs) {
+    assert(lhs.col_count() == rhs.row_count());
+    Matrix result(lhs.row_count(), rhs.col_count());
+    kernels::active().gemm(lhs.row_count(), lhs.col_count(), rhs.col_count(),
+        lhs.row_ptr(0), lhs.row_stride(), rhs.row_ptr(0), rhs.row_stride(), result.data().data(), result.row_stride());
     return result;
 }
 
-Matrix mmrt(const Matrix& lhs, const Matrix& rhs) {
-    assert(lhs.cols == rhs.cols);
-    Matrix result(lhs.rows, rhs.rows);
-
-    for (size_t row = 0; row < lhs.rows; row++) {
-        auto result_row = result[row];
-        auto left_row = lhs[row];
-        for (size_t row2 = 0; row2 < rhs.rows; row2++) {
-            double sum = 0;
-            auto right_row = rhs[row2];
-            for (size_t k = 0; k < rhs.cols; k++) {
-                sum += left_row[k] * right_row[k];
-            }
-            result_row[row2] = sum;
-        }
-    }
+Matrix mmrt(ConstMatrixView lhs, ConstMatrixView rhs) {
+    assert(lhs.col_count() == rhs.col_count());
+    Matrix result(lhs.row_count(), rhs.row_count());
+    kernels::active().gemm_rt(lhs.row_count(), lhs.col_count(), rhs.row_count(),
+        lhs.row_ptr(0), lhs.row_stride(), rhs.row_ptr(0), rhs.row_stride(), result.data().data(), result.row_stride());
     return result;
 }
 
 
-Matrix& Matrix::add_col(const Matrix& rhs) {
-    assert(rhs.cols == 1 && "add_col expects column vector");
+Matrix& Matrix::add_col(ConstMatrixView rhs) {
+    assert(rhs.col_count() == 1 && "add_col expects column vector");
     for (size_t i = 0; i < rows; i++) {
-        double val = rhs._data[i];
+        double val = rhs[i][0];
         for (size_t j = 0; j < cols; j++) (*this).operator[](i)[j] += val;
     }
     return (*this);
 }
 
-void print_mat(const Matrix& mat) {
+void print_mat(ConstMatrixView mat) {
     if (mat.size() == 0) { printf("[]\n"); return; }
     printf("[\n");
     for (size_t r = 0; r < mat.row_count(); r++) {
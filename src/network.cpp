@@ -14,7 +14,8 @@ Layer::Layer(size_t input_size, size_t output_size):
     std::normal_distribution d1{0.0, sqrt(2.0 / (input_size + output_size))};
     std::normal_distribution d2{0.0, sqrt(2.0 / (input_size + output_size))}; // mean = 5.0, stddev = 2.0
     
-    for (size_t i = 0; i < weights.size(); i++) weights.data()[i] = d1(gen);
+    for (size_t r = 0; r < weights.row_count(); r++)
+        for (double& weight : weights[r]) weight = d1(gen);
     for (size_t i = 0; i < bias.size(); i++) bias.data()[i] = d2(gen);
 }
 
@@ -1,12 +1,23 @@
 #include <network2.hpp>
 #include <matrix.hpp>
-#include <random>
+#include <numeric>
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <utility>
 #include <functions.hpp>
+#include <distributed.hpp>
+#include <kernels.hpp>
+#include <atomic>
 
 // #define NN_DIAG
 
+// Substreams of Network::rng: stream l initializes layer l, shuffle rounds
+// start at shuffle_stream and node layer l draws dropout masks from
+// dropout_stream + l
+static constexpr uint64_t shuffle_stream = (uint64_t)1 << 32;
+static constexpr uint64_t dropout_stream = (uint64_t)1 << 48;
+
 
 LayerParams::LayerParams(size_t input_size, size_t output_size) 
 : weights(0.0, output_size, input_size), bias(0.0, output_size, 1) {}
@@ -14,90 +25,584 @@ LayerParams::LayerParams(size_t input_size, size_t output_size)
 LayerParams::LayerParams(Matrix weights, Matrix bias) : weights(weights), bias(bias) {}
 
 
-Layer::Layer(size_t input_size, size_t output_size, bool is_random): 
+Layer::Layer(size_t input_size, size_t output_size, const Philox* init): 
 params(input_size, output_size) {
 
-    if (!is_random) return;
-    std::random_device rd{}; // Get initial seed from hardware random source
-    std::mt19937 gen{rd()}; // Mersenne Twister
-    std::normal_distribution d1{0.0, sqrt(2.0 / (input_size + output_size))};
-    std::normal_distribution d2{0.0, sqrt(2.0 / (input_size + output_size))};
-    
-    for (size_t i = 0; i < params.weights.size(); i++) params.weights.data()[i] = d1(gen);
-    for (size_t i = 0; i < params.bias.size(); i++) params.bias.data()[i] = d2(gen);
+    if (!init) return;
+    const double stddev = sqrt(2.0 / (input_size + output_size));
+    Matrix& weights = params.weights;
+    const size_t count = weights.row_count() * weights.col_count();
+    // Weight (r, c) is value r * cols + c of the stream whether or not rows are
+    // padded; the biases follow
+    if (weights.row_stride() == weights.col_count())
+        init->fill_normal(weights.data(), 0.0, stddev);
+    else for (size_t r = 0; r < weights.row_count(); r++)
+        init->fill_normal(weights[r], 0.0, stddev, r * weights.col_count());
+    init->fill_normal(params.bias.data(), 0.0, stddev, count);
 }
 
-void Network::backward_prop(Matrix target) {
-    int l = layers.size() - 1;
+bool Layer::has_batch_norm() const { return params.gamma.size() > 0; }
+
+// Sums the columns of a batch (a column vector is returned as is)
+static Matrix row_sums(Matrix mat) {
+    if (mat.col_count() == 1) return mat;
+    Matrix sums(0.0, mat.row_count(), 1);
+    for (size_t r = 0; r < mat.row_count(); r++)
+        for (double val : mat[r]) sums[r][0] += val;
+    return sums;
+}
+
+void Network::backward_prop(ConstMatrixView target, const std::function<void(size_t)>& layer_done) {
+    const size_t L = layers.size();
 
     Matrix grad = (*this.*output_err)(target);
-    deltas[l].bias = grad;
-    
-    deltas[l].weights = mmrt(grad, activations[l]);
+    if (compute_precision != precision::Double) grad *= loss_scale;
 
-    while ((--l) >= 0) {
-        grad = hadamard(layers[l].diff_activation(z_values[l+1]), transpose(layers[l+1].params.weights) * grad); 
-        deltas[l].bias = grad;
-        deltas[l].weights = mmrt(grad, activations[l]);
+    // Walk the checkpoint segments [begin, end) from the output back to the input
+    size_t end = L;
+    while (end > 0) {
+        size_t begin = checkpoint_every ? (end - 1) / checkpoint_every * checkpoint_every : 0;
+        recompute_segment(begin, end);
+        for (size_t l = end; l-- > begin;) {
+            if (l + 1 < L) {
+                Matrix back = compute_precision == precision::Double
+                    ? transpose(layers[l+1].params.weights) * grad
+                    : mmlt(half_weights[l+1], grad);
+                if (training && layers[l].dropout > 0.0) back = hadamard(back, dropout_mask(l + 1, back.col_count()));
+                grad = hadamard(layers[l].diff_activation(z_values[l+1]), back);
+            }
+            if (layers[l].has_batch_norm()) {
+                // grad is dL/d(gamma * xhat + beta); carry it back to z = W a + b, through
+                // the batch mean and variance in training mode
+                const Layer& layer = layers[l];
+                const Matrix& xhat = norm_values[l+1];
+                const size_t batch = grad.col_count();
+                deltas[l].gamma = Matrix(0.0, grad.row_count(), 1);
+                deltas[l].beta = Matrix(0.0, grad.row_count(), 1);
+                for (size_t r = 0; r < grad.row_count(); r++) {
+                    const double gamma = layer.params.gamma[r][0], inv_std = norm_inv_std[l+1][r][0];
+                    double& dgamma = deltas[l].gamma[r][0];
+                    double& dbeta = deltas[l].beta[r][0];
+                    if (training) {
+                        kernels::active().batch_norm_backward(grad[r].data(), xhat[r].data(), batch, gamma, inv_std,
+                            &dgamma, &dbeta, grad[r].data());
+                        continue;
+                    }
+                    // The running statistics are constants
+                    for (size_t c = 0; c < batch; c++) {
+                        dgamma += grad[r][c] * xhat[r][c];
+                        dbeta += grad[r][c];
+                        grad[r][c] *= gamma * inv_std;
+                    }
+                }
+            }
+            deltas[l].bias = row_sums(grad);
+            deltas[l].weights = mmrt(grad, layer_input(l), compute_precision);
+            if (layer_done) layer_done(l);
+        }
+        release_segment(begin, end);
+        end = begin;
     }
+    input_view = ConstMatrixView(nullptr, 0, 0, 0);
 }
 
-Matrix Network::output_error(const Matrix& target) {
+Matrix Network::output_error(ConstMatrixView target) {
     int l = layers.size() - 1;
     return hadamard((layers[l].diff_activation)(z_values[l+1]), (dcost_func)(activations[l+1], target));
 }
 
-Matrix Network::output_error_softcross(const Matrix& target) {
+Matrix Network::output_error_softcross(ConstMatrixView target) {
     int l = activations.size() - 1;
 
     return activations[l] - target;
 }
 
-Matrix& Network::forward_prop(Matrix input) {
-    z_values[0] = activations[0] = input;
-    for (size_t l = 1; l < z_values.size(); ++l) {
-        z_values[l] = layers[l - 1].params.weights * activations[l - 1]
-            + layers[l - 1].params.bias;
-        activations[l] = layers[l - 1].activation(z_values[l]);
+ConstMatrixView Network::layer_input(size_t l) const {
+    return l == 0 ? input_view : activations[l].view();
+}
+
+void Network::forward_layer(size_t l) {
+    const Layer& layer = layers[l - 1];
+    Matrix z = compute_precision == precision::Double
+        ? layer.params.weights * layer_input(l - 1)
+        : half_weights[l - 1] * layer_input(l - 1);
+    z.add_col(layer.params.bias);
+    if (layer.has_batch_norm()) batch_normalize(l, z);
+    else z_values[l] = std::move(z);
+    activations[l] = layer.activation(z_values[l]);
+    if (training && layer.dropout > 0.0) activations[l] = hadamard(activations[l], dropout_mask(l, z_values[l].col_count()));
+}
+
+// Normalizes z into z_values[l], keeping xhat and 1 / sqrt(var + eps) for the
+// backward pass: over the columns of the batch in training mode, with the
+// running statistics otherwise
+void Network::batch_normalize(size_t l, const Matrix& z) {
+    const Layer& layer = layers[l - 1];
+    const size_t n = z.row_count(), batch = z.col_count();
+    norm_values[l] = Matrix(n, batch);
+    z_values[l] = Matrix(n, batch);
+    norm_inv_std[l] = Matrix(n, 1);
+    for (size_t r = 0; r < n; r++) {
+        double mean = layer.norm_mean[r][0], var = layer.norm_var[r][0];
+        if (training) {
+            mean = 0.0, var = 0.0;
+            for (double val : z[r]) mean += val;
+            mean /= (double)batch;
+            for (double val : z[r]) var += (val - mean) * (val - mean);
+            var /= (double)batch;
+            if (collect_norm_stats) {
+                norm_sums[l - 1][r][0] += mean * (double)batch;
+                norm_squares[l - 1][r][0] += (var + mean * mean) * (double)batch;
+            }
+        }
+        const double inv_std = 1.0 / sqrt(var + norm_epsilon);
+        norm_inv_std[l][r][0] = inv_std;
+        kernels::active().batch_norm(z[r].data(), batch, mean, inv_std, layer.params.gamma[r][0],
+            layer.params.beta[r][0], norm_values[l][r].data(), z_values[l][r].data());
+    }
+}
+
+// Mask of node layer l for `batch` columns: element (i, j) is value
+// (dropout_round + j) * width + i of the layer's dropout stream
+Matrix Network::dropout_mask(size_t l, size_t batch) const {
+    const size_t width = layers[l - 1].params.weights.row_count();
+    const Philox stream = rng.substream(dropout_stream + l);
+    Matrix mask(width, batch);
+    if (batch == 1) {
+        stream.fill_dropout_mask(mask.data(), layers[l - 1].dropout, dropout_round * width);
+        return mask;
+    }
+    std::vector<double> values(width * batch);
+    stream.fill_dropout_mask(values, layers[l - 1].dropout, dropout_round * width);
+    for (size_t i = 0; i < width; i++)
+        for (size_t j = 0; j < batch; j++) mask[i][j] = values[j * width + i];
+    return mask;
+}
+
+Matrix& Network::forward_prop(ConstMatrixView input) {
+    Matrix& output = forward_pass(input);
+    input_view = ConstMatrixView(nullptr, 0, 0, 0);
+    return output;
+}
+
+Matrix& Network::forward_pass(ConstMatrixView input) {
+    const size_t L = layers.size();
+    input_view = input;
+    if (half_weights_stale) refresh_half_weights();
+    for (size_t l = 1; l <= L; ++l) {
+        size_t held = layer_bytes(l);
+        forward_layer(l);
+        note_layer(l, held);
+        if (!checkpoint_every) continue;
+        // Keep the output and the checkpointed activations only
+        if (l < L) release_layer(l, true);
+        if ((l - 1) % checkpoint_every != 0) release_layer(l - 1, false);
     }
     return activations.back();
 }
 
+// Rebuilds z_values/activations in (begin, end] from the checkpoint at `begin`.
+// The output layer is never released so it is not recomputed.
+void Network::recompute_segment(size_t begin, size_t end) {
+    if (!checkpoint_every) return;
+    for (size_t l = begin + 1; l <= end && l < layers.size(); l++) {
+        size_t held = layer_bytes(l);
+        forward_layer(l);
+        note_layer(l, held);
+    }
+}
+
+void Network::release_segment(size_t begin, size_t end) {
+    if (!checkpoint_every) return;
+    for (size_t l = begin + 1; l < end; l++) release_layer(l, false);
+    if (end < layers.size()) release_layer(end, true);
+}
+
+size_t Network::layer_bytes(size_t l) const {
+    return (z_values[l].size() + norm_values[l].size() + activations[l].size()) * sizeof(double);
+}
+
+// Accounts for node layer l having held `held` bytes before it was rebuilt
+void Network::note_layer(size_t l, size_t held) {
+    live_bytes = live_bytes - held + layer_bytes(l);
+    if (live_bytes > peak_bytes) peak_bytes = live_bytes;
+}
+
+// Frees node layer l's buffers, other than its activation if `keep_activation`
+void Network::release_layer(size_t l, bool keep_activation) {
+    live_bytes -= layer_bytes(l);
+    z_values[l] = norm_values[l] = Matrix(0, 0);
+    if (!keep_activation) activations[l] = Matrix(0, 0);
+    live_bytes += layer_bytes(l);
+}
+
+// Full recount, after the buffers were reshaped wholesale
+void Network::count_memory() {
+    live_bytes = 0;
+    for (size_t l = 0; l < z_values.size(); l++) live_bytes += layer_bytes(l);
+    if (live_bytes > peak_bytes) peak_bytes = live_bytes;
+}
+
+void Network::parameters_changed() {
+    static std::atomic<uint64_t> next_version{1};
+    model_version = next_version.fetch_add(1, std::memory_order_relaxed);
+    serving_stale = true;
+}
+
+void Network::compile_plan() {
+    parameters_changed();
+    plan = ExecutionPlan(inference_layers());
+    plan_scratch.assign(plan.scratch_size(), 0.0);
+}
+
+// Refolded lazily, so training steps pay nothing for it
+const std::vector<Layer>& Network::inference_layers() {
+    if (!serving_stale) return serving_layers.empty() ? layers : serving_layers;
+    serving_stale = false;
+    serving_layers.clear();
+    for (const Layer& layer : layers) {
+        if (!layer.has_batch_norm()) continue;
+        serving_layers = fold_for_inference(layers);
+        break;
+    }
+    return serving_layers.empty() ? layers : serving_layers;
+}
+
+std::span<const double> Network::infer(ConstMatrixView input) {
+    Matrix packed(0, 0);
+    std::span<const double> values;
+    if (input.is_contiguous()) values = std::span(input.row_ptr(0), input.size());
+    else values = (packed = Matrix(input)).data();
+
+    if (cache && cache->lookup(values, model_version, cached_output)) return cached_output;
+    // Rebinding is a few pointer stores and keeps the plan valid across refolds and copies
+    plan.bind(inference_layers());
+    std::span<const double> out = plan.run(values, plan_scratch);
+    if (cache) cache->insert(values, model_version, out);
+    return out;
+}
+
+const ExecutionPlan& Network::execution_plan() const { return plan; }
+
+void Network::set_inference_cache(std::shared_ptr<InferenceCache> shared) { cache = std::move(shared); }
+const std::shared_ptr<InferenceCache>& Network::inference_cache() const { return cache; }
+uint64_t Network::version() const { return model_version; }
+
+double Network::cost(ConstMatrixView input, ConstMatrixView target) {
+    return cost_func(forward_prop(input), target);
+}
+
+const std::vector<LayerParams>& Network::gradient(ConstMatrixView input, ConstMatrixView target) {
+    forward_pass(input);
+    backward_prop(target);
+    return deltas;
+}
+
+size_t Network::layer_count() const { return layers.size(); }
+uint64_t Network::seed() const { return rng.get_seed(); }
+
+
+std::vector<size_t> Network::shuffled_order(size_t n) {
+    std::vector<size_t> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    // Each round shuffles with its own stream
+    rng.substream(shuffle_stream + shuffle_round++).shuffle(order);
+    return order;
+}
+LayerParams& Network::parameters(size_t layer) {
+    parameters_changed();
+    half_weights_stale = compute_precision != precision::Double;
+    return layers[layer].params;
+}
+
+void Network::set_training(bool enabled) { training = enabled; }
+
+void Network::set_checkpointing(size_t every) {
+    checkpoint_every = every;
+    // Drop what the new mode would not have kept
+    if (every) for (size_t l = 1; l < layers.size(); l++) {
+        z_values[l] = norm_values[l] = Matrix(0, 0);
+        if (l % every != 0) activations[l] = Matrix(0, 0);
+    }
+    count_memory();
+}
+
+size_t Network::peak_activation_bytes() const { return peak_bytes; }
+
+void Network::reset_memory_stats() { peak_bytes = live_bytes; }
+
+void Network::set_precision(precision p, double initial_loss_scale, int window) {
+    compute_precision = p;
+    loss_scale = p == precision::Double ? 1.0 : initial_loss_scale;
+    loss_scale_window = window;
+    good_steps = 0;
+    half_weights.clear();
+    refresh_half_weights();
+}
+
+double Network::current_loss_scale() const { return loss_scale; }
+
+// Re-rounds the 16-bit weight copies in place once per update
+void Network::refresh_half_weights() {
+    half_weights_stale = false;
+    if (compute_precision == precision::Double) {
+        half_weights.clear();
+        return;
+    }
+    if (half_weights.size() != layers.size()) {
+        half_weights.clear();
+        half_weights.reserve(layers.size());
+        for (const auto& layer : layers) half_weights.push_back(HalfMatrix(layer.params.weights, compute_precision));
+        return;
+    }
+    for (size_t l = 0; l < layers.size(); l++) half_weights[l].assign(layers[l].params.weights);
+}
+
+// Applies `params -= step * delta_sum`, undoing loss scaling first.
+// Returns false if the step was skipped because of overflow.
+bool Network::apply_update(const std::vector<LayerParams>& delta_sum, double step) {
+    if (compute_precision != precision::Double) {
+        bool finite = true;
+        for (const auto& delta : delta_sum) {
+            for (double val : delta.weights.data()) finite &= std::isfinite(val);
+            for (double val : delta.bias.data()) finite &= std::isfinite(val);
+            for (double val : delta.gamma.data()) finite &= std::isfinite(val);
+            for (double val : delta.beta.data()) finite &= std::isfinite(val);
+        }
+        if (!finite) {
+            // The step leaves the network as it was, running statistics included
+            loss_scale = fmax(loss_scale / 2.0, 1.0);
+            good_steps = 0;
+            clear_norm_sums();
+            return false;
+        }
+        step /= loss_scale;
+        if (++good_steps == loss_scale_window) {
+            if (loss_scale * 2.0 <= max_loss_scale) loss_scale *= 2.0;
+            good_steps = 0;
+        }
+    }
+    update_norm_stats();
+    parameters_changed();
+    for (size_t i = 0; i < layers.size(); i++) {
+        layers[i].params.bias -= delta_sum[i].bias * step;
+        layers[i].params.weights -= delta_sum[i].weights * step;
+        if (!layers[i].has_batch_norm()) continue;
+        layers[i].params.gamma -= delta_sum[i].gamma * step;
+        layers[i].params.beta -= delta_sum[i].beta * step;
+    }
+    refresh_half_weights();
+    return true;
+}
+
+// Moves the running statistics towards the moments of the batches since the
+// last update (unbiased variance). The first 1 / norm_momentum updates are
+// averaged evenly, so inference does not lean on the initial (0, 1) for long.
+void Network::update_norm_stats() {
+    if (norm_count == 0.0) return;
+    const double momentum = fmax(norm_momentum, 1.0 / (double)++norm_updates);
+    const double unbias = norm_count > 1.0 ? norm_count / (norm_count - 1.0) : 1.0;
+    for (size_t i = 0; i < layers.size(); i++) {
+        if (!layers[i].has_batch_norm()) continue;
+        Matrix& mean = layers[i].norm_mean;
+        Matrix& var = layers[i].norm_var;
+        for (size_t j = 0; j < mean.size(); j++) {
+            double batch_mean = norm_sums[i].data()[j] / norm_count;
+            double batch_var = fmax(norm_squares[i].data()[j] / norm_count - batch_mean * batch_mean, 0.0) * unbias;
+            mean.data()[j] += momentum * (batch_mean - mean.data()[j]);
+            var.data()[j] += momentum * (batch_var - var.data()[j]);
+        }
+    }
+    clear_norm_sums();
+}
+
+void Network::clear_norm_sums() {
+    for (size_t i = 0; i < layers.size(); i++) {
+        norm_sums[i] *= 0.0;
+        norm_squares[i] *= 0.0;
+    }
+    norm_count = 0.0;
+}
+
+bool Network::trains_in_batches() const {
+    return std::any_of(layers.begin(), layers.end(), [](const Layer& layer) { return layer.has_batch_norm(); });
+}
+
+std::vector<LayerParams> Network::zeroed_deltas() const {
+    std::vector<LayerParams> delta_sum;
+    delta_sum.reserve(layers.size());
+    
+    // Zero out delta_sum in layers' structure
+    for (size_t i = 0; i < layers.size(); i++) {
+        delta_sum.push_back({
+            Matrix(layers[i].params.weights.row_count(), layers[i].params.weights.col_count()),
+            Matrix(layers[i].params.bias.row_count(), layers[i].params.bias.col_count())
+        });
+        delta_sum.back().gamma = Matrix(layers[i].params.gamma.row_count(), layers[i].params.gamma.col_count());
+        delta_sum.back().beta = Matrix(layers[i].params.beta.row_count(), layers[i].params.beta.col_count());
+    }
+    return delta_sum;
+}
+
+void Network::accumulate_example(ConstMatrixView input, ConstMatrixView target, std::vector<LayerParams>& delta_sum,
+    const std::function<void(size_t)>& layer_done) {
+    const bool was_training = training;
+    training = collect_norm_stats = true;
+    forward_pass(input);
+    collect_norm_stats = false;
+    norm_count += (double)input.col_count();
+    backward_prop(target, [&](size_t i) {
+        delta_sum[i].bias += deltas[i].bias;
+        delta_sum[i].weights += deltas[i].weights;
+        if (layers[i].has_batch_norm()) {
+            delta_sum[i].gamma += deltas[i].gamma;
+            delta_sum[i].beta += deltas[i].beta;
+        }
+        if (layer_done) layer_done(i);
+    });
+    training = was_training;
+    dropout_round += input.col_count();
+}
+
+void Network::accumulate_batch(std::span<const ConstMatrixView> inputs, std::span<const ConstMatrixView> targets,
+    std::vector<LayerParams>& delta_sum, const std::function<void(size_t)>& layer_done) {
+    assert(inputs.size() == targets.size() && "accumulate_batch: one target per input");
+    if (inputs.empty()) return;
+    if (!trains_in_batches()) {
+        for (size_t e = 0; e < inputs.size(); e++)
+            accumulate_example(inputs[e], targets[e], delta_sum,
+                e + 1 < inputs.size() ? std::function<void(size_t)>() : layer_done);
+        return;
+    }
+    // Batch norm needs every example of the batch in the same forward pass
+    Matrix packed_inputs(inputs[0].row_count(), inputs.size()), packed_targets(targets[0].row_count(), targets.size());
+    for (size_t e = 0; e < inputs.size(); e++) {
+        for (size_t r = 0; r < packed_inputs.row_count(); r++) packed_inputs[r][e] = inputs[e][r][0];
+        for (size_t r = 0; r < packed_targets.row_count(); r++) packed_targets[r][e] = targets[e][r][0];
+    }
+    accumulate_example(packed_inputs, packed_targets, delta_sum, layer_done);
+}
+
 void Network::train(int iters, std::span<std::pair<const Matrix, const Matrix>> batch, double eta) {
+    std::vector<ConstMatrixView> inputs, targets;
+    for (const auto& example : batch) {
+        inputs.push_back(example.first);
+        targets.push_back(example.second);
+    }
     for (int iter = 0; iter < iters; iter++) {
-        std::vector<LayerParams> delta_sum;
-        delta_sum.reserve(layers.size());
-        
-        // Zero out delta_sum in layers' structure
-        for (size_t i = 0; i < layers.size(); i++) {
-            delta_sum.push_back({
-                Matrix(layers[i].params.weights.row_count(), layers[i].params.weights.col_count()),
-                Matrix(layers[i].params.bias.row_count(), layers[i].params.bias.col_count())
-            });
-        }
+        std::vector<LayerParams> delta_sum = zeroed_deltas();
         // Backpropagation
-        for (const auto& example : batch) {
-            forward_prop(example.first);
-            backward_prop(example.second);
-            for (size_t i = 0; i < layers.size(); i++) {
-                delta_sum[i].bias += deltas[i].bias;
-                delta_sum[i].weights += deltas[i].weights;
+        accumulate_batch(inputs, targets, delta_sum);
+        // Update
+        apply_update(delta_sum, eta / (double)batch.size());
+        #ifdef NN_DIAG
+        // The last example is the last column, also when batch norm packed the batch
+        const Matrix& out = activations.back();
+        printf("Iter %d cost = %lf\n", iter, cost_func(out.view().col_block(out.col_count() - 1, 1), std::get<1>(batch.back())));
+        #endif
+    }
+}
+
+void Network::train(int iters, ConstMatrixView inputs, ConstMatrixView targets, double eta) {
+    assert(inputs.row_count() == targets.row_count() && "train: inputs and targets need one row per example");
+    std::vector<ConstMatrixView> input_cols, target_cols;
+    for (size_t e = 0; e < inputs.row_count(); e++) {
+        input_cols.push_back(inputs.row_as_col(e));
+        target_cols.push_back(targets.row_as_col(e));
+    }
+    for (int iter = 0; iter < iters; iter++) {
+        std::vector<LayerParams> delta_sum = zeroed_deltas();
+        accumulate_batch(input_cols, target_cols, delta_sum);
+        apply_update(delta_sum, eta / (double)inputs.row_count());
+        #ifdef NN_DIAG
+        const Matrix& out = activations.back();
+        printf("Iter %d cost = %lf\n", iter, cost_func(out.view().col_block(out.col_count() - 1, 1), targets.row_as_col(targets.row_count() - 1)));
+        #endif
+    }
+}
+
+void Network::train_sgd(int epochs, ConstMatrixView inputs, ConstMatrixView targets, size_t batch_size, double eta) {
+    assert(inputs.row_count() == targets.row_count() && "train_sgd: inputs and targets need one row per example");
+    assert(batch_size > 0 && "train_sgd: batch_size must be positive");
+    const size_t n = inputs.row_count();
+    std::vector<ConstMatrixView> input_cols, target_cols;
+    for (int epoch = 0; epoch < epochs; epoch++) {
+        std::vector<size_t> order = shuffled_order(n);
+        for (size_t begin = 0; begin < n; begin += batch_size) {
+            size_t end = std::min(n, begin + batch_size);
+            input_cols.clear();
+            target_cols.clear();
+            for (size_t i = begin; i < end; i++) {
+                input_cols.push_back(inputs.row_as_col(order[i]));
+                target_cols.push_back(targets.row_as_col(order[i]));
             }
+            std::vector<LayerParams> delta_sum = zeroed_deltas();
+            accumulate_batch(input_cols, target_cols, delta_sum);
+            apply_update(delta_sum, eta / (double)(end - begin));
         }
-        // Update
+    }
+}
+
+void Network::sync_parameters(RingComm& comm) {
+    // Broadcast rank 0's parameters: every other rank contributes zeros to the sum
+    for (auto& layer : layers) {
+        for (Matrix* mat : { &layer.params.weights, &layer.params.bias, &layer.params.gamma,
+            &layer.params.beta, &layer.norm_mean, &layer.norm_var }) {
+            if (comm.get_rank() != 0) *mat *= 0.0;
+            comm.allreduce(mat->data());
+        }
+    }
+    parameters_changed();
+    refresh_half_weights();
+}
+
+void Network::train_distributed(int iters, std::span<std::pair<const Matrix, const Matrix>> shard, double eta, RingComm& comm) {
+    double global_size = (double)shard.size();
+    comm.allreduce(std::span(&global_size, 1));
+    assert(global_size > 0 && "train_distributed: all shards are empty");
+    std::vector<ConstMatrixView> inputs, targets;
+    for (const auto& example : shard) {
+        inputs.push_back(example.first);
+        targets.push_back(example.second);
+    }
+
+    for (int iter = 0; iter < iters; iter++) {
+        std::vector<LayerParams> delta_sum = zeroed_deltas();
+        // Hands each layer's gradient sum to the comm thread as soon as it is final
+        auto reduce_layer = [&](size_t i) {
+            comm.allreduce_async(delta_sum[i].weights.data());
+            comm.allreduce_async(delta_sum[i].bias.data());
+            comm.allreduce_async(delta_sum[i].gamma.data());
+            comm.allreduce_async(delta_sum[i].beta.data());
+        };
+
+        // The last backward pass overlaps the ring all-reduce of layer l with backprop
+        // of l - 1. Batch norm normalizes over the local shard.
+        accumulate_batch(inputs, targets, delta_sum, reduce_layer);
+        // An empty shard still has to take part in every reduction, in the same order
+        if (shard.empty())
+            for (size_t i = layers.size(); i-- > 0;) reduce_layer(i);
+        comm.wait();
+
+        // The running statistics average over the global batch
         for (size_t i = 0; i < layers.size(); i++) {
-            layers[i].params.bias -= delta_sum[i].bias * (eta / (double)batch.size());
-            layers[i].params.weights -= delta_sum[i].weights * (eta / (double)batch.size());
+            if (!layers[i].has_batch_norm()) continue;
+            comm.allreduce(norm_sums[i].data());
+            comm.allreduce(norm_squares[i].data());
         }
-        #ifdef NN_DIAG
-        printf("Iter %d cost = %lf\n", iter, cost_func(activations.back(), std::get<1>(batch.back())));
-        #endif
+        comm.allreduce(std::span(&norm_count, 1));
+
+        // Update
+        apply_update(delta_sum, eta / global_size);
     }
 }
 
-Network define_network(std::vector<LayerDefs> layers, cost_fn cost_function, output_type output_def) {
+Network define_network(std::vector<LayerDefs> layers, cost_fn cost_function, output_type output_def, uint64_t seed) {
     assert(layers.size() >= 2 && "define_network: at least 2 layers must be specified.");
+    assert(layers[0].dropout == 0.0 && !layers[0].batch_norm && "define_network: the input layer takes no dropout or batch norm");
+    assert(layers.back().dropout == 0.0 && "define_network: dropout is not supported on the output layer");
     Network network;
+    network.rng = Philox(seed);
     network.layers.reserve(layers.size() - 1);
     network.z_values.reserve(layers.size());
     network.activations.reserve(layers.size());
@@ -120,7 +625,7 @@ Network define_network(std::vector<LayerDefs> layers, cost_fn cost_function, out
     for (size_t i = 0; i < layers.size() - 1; i++) {
         std::array<Activation, 2> acts = { nullptr, nullptr };
         switch (layers[i + 1].activation) {
-            case activation_fn::Null: break;
+            case activation_fn::Null: acts = { nn_funcs::identity, nn_funcs::didentity }; break;
             case activation_fn::ReLU: acts = { nn_funcs::relu, nn_funcs::drelu }; break;
             case activation_fn::Sigmoid : acts = { nn_funcs::sigmoid, nn_funcs::dsigmoid }; break;
             case activation_fn::Softmax : { 
@@ -134,14 +639,36 @@ Network define_network(std::vector<LayerDefs> layers, cost_fn cost_function, out
             default: break;
         }
         network.deltas.push_back(LayerParams(layers[i].num_nodes, layers[i+1].num_nodes));
-        network.layers.push_back(Layer(layers[i].num_nodes, layers[i+1].num_nodes));
+        Philox init = network.rng.substream(i);
+        network.layers.push_back(Layer(layers[i].num_nodes, layers[i+1].num_nodes, &init));
         network.activations.push_back(Matrix(layers[i+1].num_nodes, 1));
         network.z_values.push_back(Matrix(layers[i].num_nodes, 1));
         network.layers.back().activation = acts[0];
         network.layers.back().diff_activation = acts[1];
+        network.layers.back().activation_type = layers[i + 1].activation;
+
+        const LayerDefs& def = layers[i + 1];
+        const size_t n = def.num_nodes;
+        assert(def.dropout >= 0.0 && def.dropout < 1.0 && "define_network: dropout must be in [0, 1)");
+        Layer& layer = network.layers.back();
+        layer.dropout = def.dropout;
+        if (def.batch_norm) {
+            layer.params.gamma = Matrix(1.0, n, 1);
+            layer.params.beta = Matrix(0.0, n, 1);
+            layer.norm_mean = Matrix(0.0, n, 1);
+            layer.norm_var = Matrix(1.0, n, 1);
+        }
+        network.norm_sums.push_back(def.batch_norm ? Matrix(0.0, n, 1) : Matrix(0, 0));
+        network.norm_squares.push_back(def.batch_norm ? Matrix(0.0, n, 1) : Matrix(0, 0));
     }
+    network.norm_values.assign(layers.size(), Matrix(0, 0));
+    network.norm_inv_std.assign(layers.size(), Matrix(0, 0));
     network.activations.push_back(Matrix(layers.back().num_nodes, 1));
     network.z_values.push_back(Matrix(layers.back().num_nodes, 1));
+    // Layer 0 is the caller's input, seen through input_view
+    network.activations[0] = network.z_values[0] = Matrix(0, 0);
+    network.count_memory();
+    network.compile_plan();
 
     return network;
 }
\ No newline at end of file
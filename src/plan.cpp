@@ -0,0 +1,78 @@
+#include <network2.hpp>
+#include <kernels.hpp>
+#include <cassert>
+#include <cmath>
+#include <algorithm>
+
+std::vector<Layer> fold_for_inference(const std::vector<Layer>& layers) {
+    std::vector<Layer> folded = layers;
+    for (Layer& layer : folded) {
+        layer.dropout = 0.0;
+        if (!layer.has_batch_norm()) continue;
+        LayerParams& params = layer.params;
+        for (size_t r = 0; r < params.weights.row_count(); r++) {
+            double scale = params.gamma[r][0] / sqrt(layer.norm_var[r][0] + norm_epsilon);
+            for (double& w : params.weights[r]) w *= scale;
+            params.bias[r][0] = scale * (params.bias[r][0] - layer.norm_mean[r][0]) + params.beta[r][0];
+        }
+        params.gamma = params.beta = layer.norm_mean = layer.norm_var = Matrix(0, 0);
+    }
+    return folded;
+}
+
+ExecutionPlan::ExecutionPlan(const std::vector<Layer>& layers) {
+    assert(!layers.empty() && "ExecutionPlan: no layers");
+    input_size = layers.front().params.weights.col_count();
+    dense_chain = kernels::active().dense_chain;
+
+    // Layer l writes buffer l % 2 and reads the other one (or the plan input),
+    // so each buffer is sized for the largest output it ever holds
+    size_t buffer_size[2] = { 0, 0 };
+    for (size_t l = 0; l < layers.size(); l++) {
+        assert(!layers[l].has_batch_norm() && "ExecutionPlan: fold batch norm first (fold_for_inference)");
+        size_t rows = layers[l].params.weights.row_count();
+        buffer_size[l % 2] = std::max(buffer_size[l % 2], rows);
+        unshared_doubles += rows;
+    }
+    // The second buffer starts on a 64-byte boundary
+    const size_t buffer_offset[2] = { 0, (buffer_size[0] + 7) / 8 * 8 };
+    scratch_doubles = buffer_offset[1] + (buffer_size[1] + 7) / 8 * 8;
+
+    for (size_t l = 0; l < layers.size(); l++) {
+        kernels::dense_activation activation = kernels::dense_activation::None;
+        switch (layers[l].activation_type) {
+            case activation_fn::Null: break;
+            case activation_fn::Sigmoid: activation = kernels::dense_activation::Sigmoid; break;
+            case activation_fn::ReLU: activation = kernels::dense_activation::ReLU; break;
+            case activation_fn::Softmax: activation = kernels::dense_activation::Softmax; break;
+        }
+        const Matrix& weights = layers[l].params.weights;
+        size_t in = l == 0 ? kernels::DenseStep::npos : buffer_offset[(l - 1) % 2];
+        steps.push_back({ nullptr, 0, nullptr, weights.row_count(), weights.col_count(), in, buffer_offset[l % 2], activation });
+    }
+    output_size = steps.back().rows;
+    output_offset = steps.back().out;
+    bind(layers);
+}
+
+void ExecutionPlan::bind(const std::vector<Layer>& layers) {
+    assert(layers.size() == steps.size() && "ExecutionPlan::bind: layer count mismatch");
+    for (size_t l = 0; l < steps.size(); l++) {
+        const LayerParams& params = layers[l].params;
+        assert(params.weights.row_count() == steps[l].rows && params.weights.col_count() == steps[l].cols
+            && "ExecutionPlan::bind: layer shape mismatch");
+        steps[l].weights = params.weights.data().data();
+        steps[l].ldw = params.weights.row_stride();
+        steps[l].bias = params.bias.data().data();
+    }
+}
+
+size_t ExecutionPlan::scratch_size() const { return scratch_doubles; }
+size_t ExecutionPlan::unshared_size() const { return unshared_doubles; }
+
+std::span<const double> ExecutionPlan::run(std::span<const double> input, std::span<double> scratch) const {
+    assert(input.size() == input_size && "ExecutionPlan::run: input size mismatch");
+    assert(scratch.size() >= scratch_doubles && "ExecutionPlan::run: scratch too small");
+    dense_chain(steps.data(), steps.size(), input.data(), scratch.data());
+    return std::span<const double>(scratch.data() + output_offset, output_size);
+}
@@ -0,0 +1,163 @@
+#include <precision.hpp>
+#include <cassert>
+#include <kernels.hpp>
+#include <algorithm>
+#include <bit>
+
+namespace half_bits {
+    static uint16_t bfloat16_from_float(float val) {
+        uint32_t bits = std::bit_cast<uint32_t>(val);
+        if ((bits & 0x7FFFFFFF) > 0x7F800000) return (uint16_t)((bits >> 16) | 0x40); // Quiet NaN
+        bits += 0x7FFF + ((bits >> 16) & 1);
+        return (uint16_t)(bits >> 16);
+    }
+
+    static uint16_t float16_from_float(float val) {
+        uint32_t bits = std::bit_cast<uint32_t>(val);
+        uint16_t sign = (bits >> 16) & 0x8000;
+        uint32_t abs = bits & 0x7FFFFFFF;
+
+        if (abs > 0x7F800000) return sign | 0x7E00;  // NaN
+        if (abs >= 0x477FF000) return sign | 0x7C00; // Rounds past 65504: inf
+        if (abs < 0x38800000) {                      // Below 2^-14: subnormal
+            if (abs < 0x33000000) return sign;       // At most 2^-25: rounds to zero
+            uint32_t exp = abs >> 23, mant = (abs & 0x7FFFFF) | 0x800000;
+            uint32_t shift = 126 - exp;
+            uint32_t res = mant >> shift, rem = mant & ((1u << shift) - 1), half = 1u << (shift - 1);
+            if (rem > half || (rem == half && (res & 1))) res++;
+            return sign | (uint16_t)res;
+        }
+        // Rebias the exponent (127 -> 15) and drop 13 mantissa bits
+        uint32_t res = (abs - 0x38000000) >> 13, rem = abs & 0x1FFF;
+        if (rem > 0x1000 || (rem == 0x1000 && (res & 1))) res++;
+        return sign | (uint16_t)res;
+    }
+
+    static float float16_to_float(uint16_t bits) {
+        uint32_t sign = (uint32_t)(bits & 0x8000) << 16;
+        uint32_t exp = (bits >> 10) & 0x1F, mant = bits & 0x3FF;
+        if (exp == 0) {
+            float val = (float)mant * 0x1p-24f;
+            return sign ? -val : val;
+        }
+        if (exp == 31) return std::bit_cast<float>(sign | 0x7F800000 | (mant << 13));
+        return std::bit_cast<float>(sign | ((exp + 112) << 23) | (mant << 13));
+    }
+
+    uint16_t from_float(float val, precision format) {
+        assert(format != precision::Double && "half_bits: Double is not a 16-bit format");
+        return format == precision::BFloat16 ? bfloat16_from_float(val) : float16_from_float(val);
+    }
+
+    float to_float(uint16_t bits, precision format) {
+        assert(format != precision::Double && "half_bits: Double is not a 16-bit format");
+        return format == precision::BFloat16
+            ? std::bit_cast<float>((uint32_t)bits << 16) : float16_to_float(bits);
+    }
+}
+
+double round_to(double val, precision format) {
+    if (format == precision::Double) return val;
+    return half_bits::to_float(half_bits::from_float((float)val, format), format);
+}
+
+// Rounds `count` doubles through `format` into floats. The format is resolved
+// outside the loop so it stays branch free for bfloat16.
+static void round_floats(const double* src, size_t count, precision format, float* dst) {
+    if (format == precision::BFloat16) {
+        for (size_t i = 0; i < count; i++)
+            dst[i] = std::bit_cast<float>((uint32_t)half_bits::bfloat16_from_float((float)src[i]) << 16);
+    } else {
+        for (size_t i = 0; i < count; i++)
+            dst[i] = half_bits::float16_to_float(half_bits::float16_from_float((float)src[i]));
+    }
+}
+
+// Rounded float copy of a double operand in a per-thread buffer that is reused
+// across calls; `slot` keeps the two operands of one product apart
+static const float* round_operand(ConstMatrixView mat, precision format, int slot) {
+    thread_local std::vector<float> scratch[2];
+    std::vector<float>& res = scratch[slot];
+    if (res.size() < mat.size()) res.resize(mat.size());
+    if (mat.is_contiguous()) {
+        round_floats(mat.row_ptr(0), mat.size(), format, res.data());
+        return res.data();
+    }
+    for (size_t r = 0; r < mat.row_count(); r++)
+        round_floats(mat.row_ptr(r), mat.col_count(), format, res.data() + r * mat.col_count());
+    return res.data();
+}
+
+// Per-thread float result buffer
+static float* float_result(size_t size) {
+    thread_local std::vector<float> out;
+    if (out.size() < size) out.resize(size);
+    return out.data();
+}
+
+// Widens a packed rows x cols float result into a (possibly padded) Matrix
+static Matrix widen(const float* src, size_t rows, size_t cols) {
+    Matrix result(rows, cols);
+    for (size_t r = 0; r < rows; r++) std::copy(src + r * cols, src + (r + 1) * cols, result[r].begin());
+    return result;
+}
+
+HalfMatrix::HalfMatrix(const Matrix& mat, precision format) : rows(0), cols(0), format(format) {
+    assert(format != precision::Double && "HalfMatrix: Double is not a 16-bit format");
+    assign(mat);
+}
+
+void HalfMatrix::assign(const Matrix& mat) {
+    rows = mat.row_count();
+    cols = mat.col_count();
+    _data.resize(mat.size());
+    // Row by row: padded rows are further apart than `cols`
+    for (size_t r = 0; r < rows; r++) round_floats(mat[r].data(), cols, format, _data.data() + r * cols);
+}
+
+size_t HalfMatrix::row_count() const { return rows; }
+size_t HalfMatrix::col_count() const { return cols; }
+
+Matrix operator*(const HalfMatrix& lhs, ConstMatrixView rhs) {
+    assert(lhs.cols == rhs.row_count());
+    const size_t n = rhs.col_count();
+    const float* right = round_operand(rhs, lhs.format, 0);
+    float* out = float_result(lhs.rows * n);
+    kernels::active().sgemm(lhs.rows, lhs.cols, n, lhs._data.data(), lhs.cols, right, n, out, n);
+
+    return widen(out, lhs.rows, n);
+}
+
+Matrix mmlt(const HalfMatrix& lhs, ConstMatrixView rhs) {
+    assert(lhs.rows == rhs.row_count());
+    const size_t n = rhs.col_count();
+    const float* right = round_operand(rhs, lhs.format, 0);
+    // transpose(result) = transpose(rhs) * lhs keeps lhs access sequential
+    const float* right_t = right;
+    if (n > 1) {
+        thread_local std::vector<float> transposed;
+        if (transposed.size() < rhs.size()) transposed.resize(rhs.size());
+        for (size_t k = 0; k < lhs.rows; k++)
+            for (size_t col = 0; col < n; col++) transposed[col * lhs.rows + k] = right[k * n + col];
+        right_t = transposed.data();
+    }
+    float* out = float_result(n * lhs.cols);
+    kernels::active().sgemm(n, lhs.rows, lhs.cols, right_t, lhs.rows, lhs._data.data(), lhs.cols, out, lhs.cols);
+
+    Matrix result(lhs.cols, n);
+    for (size_t row = 0; row < lhs.cols; row++)
+        for (size_t col = 0; col < n; col++) result[row][col] = out[col * lhs.cols + row];
+    return result;
+}
+
+Matrix mmrt(ConstMatrixView lhs, ConstMatrixView rhs, precision format) {
+    if (format == precision::Double) return mmrt(lhs, rhs);
+    assert(lhs.col_count() == rhs.col_count());
+    const size_t k_len = lhs.col_count(), rows = lhs.row_count(), cols = rhs.row_count();
+    const float* left = round_operand(lhs, format, 0);
+    const float* right = round_operand(rhs, format, 1);
+    float* out = float_result(rows * cols);
+    kernels::active().sgemm_rt(rows, k_len, cols, left, k_len, right, k_len, out, cols);
+
+    return widen(out, rows, cols);
+}
@@ -0,0 +1,106 @@
+#include <network2.hpp>
+#include <matrix.hpp>
+#include <cassert>
+#include <cmath>
+
+// Copies of `mat` keeping only the listed rows / columns
+static Matrix keep_rows(const Matrix& mat, const std::vector<size_t>& rows) {
+    Matrix res(rows.size(), mat.col_count());
+    for (size_t i = 0; i < rows.size(); i++)
+        for (size_t j = 0; j < mat.col_count(); j++) res[i][j] = mat[rows[i]][j];
+    return res;
+}
+
+static Matrix keep_cols(const Matrix& mat, const std::vector<size_t>& cols) {
+    Matrix res(mat.row_count(), cols.size());
+    for (size_t i = 0; i < mat.row_count(); i++)
+        for (size_t j = 0; j < cols.size(); j++) res[i][j] = mat[i][cols[j]];
+    return res;
+}
+
+Network prune_network(const Network& network, std::span<const Matrix> calibration, double threshold, PruneReport* report) {
+    assert(!calibration.empty() && "prune_network: calibration set is empty");
+    const size_t L = network.layers.size();
+
+    // Per-neuron activation range and mean over the calibration set, for every hidden layer
+    // Scored on the inference form, so batch norm is applied and dropout is off
+    const std::vector<Layer> folded = fold_for_inference(network.layers);
+    std::vector<Matrix> lo, hi, mean;
+    for (size_t l = 1; l < L; l++) {
+        size_t n = network.layers[l - 1].params.weights.row_count();
+        lo.push_back(Matrix(INFINITY, n, 1));
+        hi.push_back(Matrix(-INFINITY, n, 1));
+        mean.push_back(Matrix(0.0, n, 1));
+    }
+    for (const Matrix& input : calibration) {
+        Matrix a = input;
+        for (size_t l = 1; l < L; l++) {
+            const Layer& layer = folded[l - 1];
+            a = layer.activation(layer.params.weights * a + layer.params.bias);
+            for (size_t j = 0; j < a.size(); j++) {
+                lo[l - 1].data()[j] = fmin(lo[l - 1].data()[j], a.data()[j]);
+                hi[l - 1].data()[j] = fmax(hi[l - 1].data()[j], a.data()[j]);
+                mean[l - 1].data()[j] += a.data()[j] / (double)calibration.size();
+            }
+        }
+    }
+
+    Network pruned = network;
+    if (report) *report = PruneReport{};
+    for (size_t l = 1; l < L; l++) {
+        LayerParams& cur = pruned.layers[l - 1].params;
+        LayerParams& next = pruned.layers[l].params;
+        // The bias fold below acts before the next layer's batch norm, so it uses
+        // the raw weights; the score uses the folded ones, which include its scaling
+        const Matrix& out_weights = network.layers[l].params.weights;
+        const Matrix& scored_weights = folded[l].params.weights;
+
+        // Largest change the neuron can make to any (normalized) input of the next layer
+        std::vector<double> score(cur.weights.row_count(), 0.0);
+        std::vector<size_t> keep;
+        size_t best = 0;
+        for (size_t j = 0; j < score.size(); j++) {
+            for (size_t i = 0; i < scored_weights.row_count(); i++) score[j] = fmax(score[j], fabs(scored_weights[i][j]));
+            score[j] *= hi[l - 1].data()[j] - lo[l - 1].data()[j];
+            if (score[j] > threshold) keep.push_back(j);
+            if (score[j] > score[best]) best = j;
+        }
+        if (keep.empty()) keep.push_back(best); // Keep the layer connected
+
+        if (report) {
+            report->nodes_before.push_back(score.size());
+            report->nodes_after.push_back(keep.size());
+        }
+        if (keep.size() == score.size()) continue;
+
+        // Replace each removed neuron by its mean contribution to the next layer
+        for (size_t j = 0, k = 0; j < score.size(); j++) {
+            if (k < keep.size() && keep[k] == j) { k++; continue; }
+            for (size_t i = 0; i < out_weights.row_count(); i++)
+                next.bias.data()[i] += out_weights[i][j] * mean[l - 1].data()[j];
+        }
+
+        cur.weights = keep_rows(cur.weights, keep);
+        cur.bias = keep_rows(cur.bias, keep);
+        if (pruned.layers[l - 1].has_batch_norm()) {
+            Layer& layer = pruned.layers[l - 1];
+            cur.gamma = keep_rows(cur.gamma, keep);
+            cur.beta = keep_rows(cur.beta, keep);
+            layer.norm_mean = keep_rows(layer.norm_mean, keep);
+            layer.norm_var = keep_rows(layer.norm_var, keep);
+            pruned.norm_sums[l - 1] = pruned.norm_squares[l - 1] = Matrix(0.0, keep.size(), 1);
+        }
+        next.weights = keep_cols(next.weights, keep);
+    }
+
+    // Resize the per-layer buffers to the new widths
+    for (size_t l = 0; l < L; l++) {
+        const Matrix& weights = pruned.layers[l].params.weights;
+        pruned.deltas[l] = LayerParams(weights.col_count(), weights.row_count());
+        if (l > 0) pruned.activations[l] = pruned.z_values[l] = Matrix(weights.col_count(), 1);
+    }
+    pruned.count_memory();
+    pruned.refresh_half_weights();
+    pruned.compile_plan();
+    return pruned;
+}
@@ -0,0 +1,89 @@
+#include <rng.hpp>
+#include <kernels.hpp>
+#include <random>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+// The Philox rounds and the Box-Muller transform are kernels (src/kernels.inc)
+// so they get the widest vector path of the host
+
+Philox::Philox(uint64_t seed, uint64_t stream) : seed(seed), stream(stream) {}
+
+Philox Philox::substream(uint64_t stream) const { return Philox(seed, stream); }
+uint64_t Philox::get_seed() const { return seed; }
+
+std::array<uint32_t, 4> Philox::block(uint64_t counter) const {
+    std::array<uint32_t, 4> words;
+    kernels::active().philox(seed, stream, counter, 1, words.data());
+    return words;
+}
+
+uint64_t Philox::bits(uint64_t index) const {
+    std::array<uint32_t, 4> words = block(index / 2);
+    size_t w = (index % 2) * 2;
+    return ((uint64_t)words[w] << 32) | words[w + 1];
+}
+
+void Philox::fill_bits(std::span<uint64_t> out, uint64_t offset) const {
+    // Two values per block; chunks keep the block buffer on the stack
+    constexpr size_t chunk_blocks = 64;
+    uint32_t words[chunk_blocks * 4];
+    const auto philox = kernels::active().philox;
+    size_t i = 0;
+    while (i < out.size()) {
+        uint64_t first = (offset + i) / 2, last = (offset + out.size() - 1) / 2;
+        size_t count = (size_t)std::min<uint64_t>(chunk_blocks, last - first + 1);
+        philox(seed, stream, first, count, words);
+        for (; i < out.size() && (offset + i) / 2 < first + count; i++) {
+            size_t w = ((offset + i) / 2 - first) * 4 + (offset + i) % 2 * 2;
+            out[i] = ((uint64_t)words[w] << 32) | words[w + 1];
+        }
+    }
+}
+
+double Philox::uniform(uint64_t index) const {
+    return ((double)(bits(index) >> 11) + 0.5) * 0x1p-53;
+}
+
+void Philox::fill_normal(std::span<double> out, double mean, double stddev, uint64_t offset, unsigned threads) const {
+    const auto normal = kernels::active().philox_normal;
+    // Below ~64K values a thread costs more to start than it saves
+    constexpr size_t min_per_thread = (size_t)1 << 16;
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = (unsigned)std::min<size_t>(threads, std::max<size_t>(1, out.size() / min_per_thread));
+    if (threads <= 1) return normal(seed, stream, offset, out.size(), mean, stddev, out.data());
+
+    // Every value depends only on its index, so any split gives the same result
+    const size_t per_thread = (out.size() + threads - 1) / threads;
+    std::vector<std::thread> workers;
+    for (size_t begin = 0; begin < out.size(); begin += per_thread) {
+        size_t count = std::min(per_thread, out.size() - begin);
+        workers.emplace_back(normal, seed, stream, offset + begin, count, mean, stddev, out.data() + begin);
+    }
+    for (auto& worker : workers) worker.join();
+}
+
+void Philox::fill_dropout_mask(std::span<double> out, double rate, uint64_t offset) const {
+    kernels::active().dropout_mask(seed, stream, offset, out.size(), rate, out.data());
+}
+
+void Philox::shuffle(std::span<size_t> order) const {
+    // Step i draws bits(i), for i = n down to 2; take them a buffer at a time
+    uint64_t draws[128];
+    for (size_t top = order.size(); top > 1;) {
+        size_t low = top > std::size(draws) + 1 ? top - std::size(draws) + 1 : 2;
+        fill_bits(std::span(draws, top - low + 1), low);
+        for (size_t i = top; i >= low; i--) {
+            // Multiply-shift maps 64 random bits onto [0, i) with negligible bias
+            size_t j = (size_t)(((unsigned __int128)draws[i - low] * i) >> 64);
+            std::swap(order[i - 1], order[j]);
+        }
+        top = low - 1;
+    }
+}
+
+uint64_t random_seed() {
+    std::random_device rd{};
+    return ((uint64_t)rd() << 32) | rd();
+}
@@ -0,0 +1,95 @@
+#include <serving.hpp>
+#include <cassert>
+#include <algorithm>
+
+ServingSnapshot::ServingSnapshot(const std::vector<Layer>& folded, uint64_t version)
+    : layers(folded), plan(layers), version(version) {}
+
+std::span<const double> ServingSnapshot::infer(ConstMatrixView input, std::vector<double>& scratch) const {
+    if (scratch.size() < plan.scratch_size()) scratch.resize(plan.scratch_size());
+    if (input.is_contiguous()) return plan.run(std::span(input.row_ptr(0), input.size()), scratch);
+    Matrix packed(input);
+    return plan.run(packed.data(), scratch);
+}
+
+std::unique_ptr<const ServingSnapshot> make_snapshot(Network& network) {
+    return std::make_unique<const ServingSnapshot>(network.inference_layers(), network.model_version);
+}
+
+SnapshotStore::Pin::Pin(std::atomic<uint64_t>* slot, const ServingSnapshot* snapshot)
+    : slot(slot), snapshot(snapshot) {}
+
+SnapshotStore::Pin::~Pin() { slot->store(idle, std::memory_order_release); }
+
+const ServingSnapshot& SnapshotStore::Pin::operator*() const { return *snapshot; }
+const ServingSnapshot* SnapshotStore::Pin::operator->() const { return snapshot; }
+
+SnapshotStore::Reader::Reader(SnapshotStore& store) : store(&store), slot(store.slot_count) {
+    for (size_t s = 0; s < store.slot_count; s++) {
+        bool expected = false;
+        if (store.slots[s].claimed.compare_exchange_strong(expected, true)) {
+            slot = s;
+            break;
+        }
+    }
+    assert(slot < store.slot_count && "SnapshotStore::Reader: every reader slot is taken");
+}
+
+SnapshotStore::Reader::~Reader() { store->slots[slot].claimed.store(false, std::memory_order_release); }
+
+// Announcing the epoch before loading `current` (both seq_cst) means a publish
+// that retires the loaded snapshot must see this slot as active in an epoch no
+// later than the retirement, and so keeps the snapshot alive.
+SnapshotStore::Pin SnapshotStore::Reader::pin() {
+    std::atomic<uint64_t>& announced = store->slots[slot].epoch;
+    assert(announced.load(std::memory_order_relaxed) == idle && "SnapshotStore::Reader: already pinned");
+    announced.store(store->epoch.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+    const ServingSnapshot* snapshot = store->current.load(std::memory_order_seq_cst);
+    assert(snapshot && "SnapshotStore::Reader: nothing published yet");
+    return Pin(&announced, snapshot);
+}
+
+std::span<const double> SnapshotStore::Reader::infer(ConstMatrixView input, uint64_t* version) {
+    Pin snapshot = pin();
+    if (version) *version = snapshot->version;
+    // The result lives in our scratch, so it stays valid after unpinning
+    return snapshot->infer(input, scratch);
+}
+
+SnapshotStore::SnapshotStore(size_t max_readers)
+    : slots(std::make_unique<ReaderSlot[]>(max_readers)), slot_count(max_readers) {}
+
+SnapshotStore::~SnapshotStore() {
+    for (size_t s = 0; s < slot_count; s++)
+        assert(!slots[s].claimed.load() && "SnapshotStore: destroyed with a registered Reader");
+    for (const Retired& old : retired) delete old.snapshot;
+    delete current.load();
+}
+
+size_t SnapshotStore::publish(std::unique_ptr<const ServingSnapshot> snapshot) {
+    std::lock_guard guard(writer_lock);
+    const ServingSnapshot* old = current.exchange(snapshot.release(), std::memory_order_seq_cst);
+    // Readers that announced this epoch or earlier may hold `old`; later ones see the new snapshot
+    uint64_t retired_in = epoch.fetch_add(1, std::memory_order_seq_cst);
+    if (old) retired.push_back({ old, retired_in });
+    return reclaim_locked();
+}
+
+size_t SnapshotStore::reclaim() {
+    std::lock_guard guard(writer_lock);
+    return reclaim_locked();
+}
+
+size_t SnapshotStore::reclaim_locked() {
+    // Everything retired before the oldest active reader's epoch is unreachable
+    uint64_t oldest = UINT64_MAX;
+    for (size_t s = 0; s < slot_count; s++) {
+        uint64_t announced = slots[s].epoch.load(std::memory_order_seq_cst);
+        if (announced != idle) oldest = std::min(oldest, announced);
+    }
+    auto still_held = std::partition(retired.begin(), retired.end(),
+        [&](const Retired& old) { return old.epoch >= oldest; });
+    for (auto it = still_held; it != retired.end(); it++) delete it->snapshot;
+    retired.erase(still_held, retired.end());
+    return retired.size();
+}